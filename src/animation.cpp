@@ -0,0 +1,127 @@
+#include "animation.h"
+
+#include <signal.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "camerapath.h"
+#include "ppm.h"
+#include "raytracer.h"
+#include "threadpool.h"
+
+namespace {
+
+struct FrameJob {
+  std::vector<Color> pixels;
+  int bandsLeft = 0;
+};
+
+}
+
+int runBatch(const BatchOptions& options, const Camera& base) {
+  std::unique_ptr<CameraPath> path;
+  try {
+    path = std::make_unique<CameraPath>(options.pathFile);
+  } catch (const std::runtime_error& error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+
+  FILE* out = options.output == "-" ? stdout : std::fopen(options.output.c_str(), "wb");
+  if (!out) {
+    std::cerr << "Unable to open " << options.output << std::endl;
+    return 1;
+  }
+  // A closed encoder pipe should end the render, not kill the process
+  signal(SIGPIPE, SIG_IGN);
+
+  const int width = options.width;
+  const int height = options.height;
+  const int frameCount = static_cast<int>(path->duration() * options.fps) + 1;
+
+  std::mutex mutex;
+  std::condition_variable bandDone;
+  std::deque<std::unique_ptr<FrameJob>> inFlight;
+  ThreadPool pool(options.threads > 0 ? options.threads : std::thread::hardware_concurrency());
+
+  // Frames are split into bands and several frames are queued at once, so the
+  // pool never drains at a frame boundary while the writer waits in order.
+  auto schedule = [&](int frame) {
+    auto job = std::make_unique<FrameJob>();
+    job->pixels.resize(static_cast<size_t>(width) * height);
+    job->bandsLeft = (height + options.bandHeight - 1) / options.bandHeight;
+
+    FrameJob* target = job.get();
+    Camera camera = path->at(frame / options.fps, base);
+    for (int y0 = 0; y0 < height; y0 += options.bandHeight) {
+      int rows = std::min(options.bandHeight, height - y0);
+      pool.submit([&, target, camera, y0, rows] {
+        renderTile(camera, width, height, 0, y0, width, rows, target->pixels.data() + static_cast<size_t>(y0) * width);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--target->bandsLeft == 0) {
+          bandDone.notify_all();
+        }
+      });
+    }
+    inFlight.push_back(std::move(job));
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Uint8> rgb(static_cast<size_t>(width) * height * 3);
+  int nextFrame = 0;
+  int written = 0;
+  bool failed = false;
+
+  for (int frame = 0; frame < frameCount && !failed; frame++) {
+    while (nextFrame < frameCount && nextFrame < frame + options.framesInFlight) {
+      schedule(nextFrame++);
+    }
+
+    FrameJob* job = inFlight.front().get();
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      bandDone.wait(lock, [job] { return job->bandsLeft == 0; });
+    }
+
+    packRGB(job->pixels.data(), job->pixels.size(), rgb.data());
+    if (std::fwrite(rgb.data(), 1, rgb.size(), out) != rgb.size()) {
+      std::cerr << "Output closed after " << written << " frames" << std::endl;
+      failed = true;
+    } else {
+      written++;
+    }
+    inFlight.pop_front();
+
+    if (written % 10 == 0 || written == frameCount) {
+      std::cerr << "frame " << written << "/" << frameCount << std::endl;
+    }
+  }
+
+  // Let any frames still queued finish before their buffers go away
+  while (!inFlight.empty()) {
+    FrameJob* job = inFlight.front().get();
+    std::unique_lock<std::mutex> lock(mutex);
+    bandDone.wait(lock, [job] { return job->bandsLeft == 0; });
+    lock.unlock();
+    inFlight.pop_front();
+  }
+
+  std::fflush(out);
+  if (out != stdout) {
+    std::fclose(out);
+  }
+
+  float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << written << " frames in " << seconds << " s, "
+            << (seconds > 0 ? written * 60.0f / seconds : 0.0f) << " frames/min on "
+            << pool.size() << " threads" << std::endl;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include "camera.h"
+
+// Renders a keyframed camera path without a window and streams the frames as
+// raw RGB24 (width * height * 3 bytes per frame, top row first) to a file or
+// to stdout ("-"), e.g. for piping into
+//   ffmpeg -f rawvideo -pix_fmt rgb24 -s 500x300 -r 30 -i - out.mp4
+struct BatchOptions {
+  std::string pathFile;
+  std::string output = "-";
+  int width = 500;
+  int height = 300;
+  float fps = 30.0f;
+  int threads = 0;        // 0 uses every core
+  int framesInFlight = 4; // frames traced concurrently, bounds memory use
+  int bandHeight = 16;    // rows per task inside a frame
+};
+
+int runBatch(const BatchOptions& options, const Camera& base);
@@ -0,0 +1,218 @@
+#include "assetbundle.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <SDL2/SDL_image.h>
+#include <print.h>
+
+namespace {
+
+const char MAGIC[8] = {'R', 'T', 'B', 'U', 'N', 'D', 'L', 'E'};
+const uint32_t VERSION = 3;
+const size_t ALIGNMENT = 64;
+
+struct BundleHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t colorSize;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct BundleEntry {
+  char source[240];
+  int64_t sourceSize;
+  int64_t sourceTime;  // modification time in nanoseconds
+  uint32_t levelCount;
+  uint32_t valid;
+  uint64_t levelsOffset;
+  uint64_t texelsOffset;
+  uint64_t texelCount;
+};
+
+struct BundleLevel {
+  int32_t width;
+  int32_t height;
+  int32_t tilesPerRow;
+  int32_t reserved;
+  uint64_t offset;
+};
+
+bool sourceStamp(const std::string& path, int64_t& size, int64_t& time) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+  size = info.st_size;
+  // Whole seconds would miss a same-size image saved again within a second
+  time = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+  return true;
+}
+
+size_t align(size_t offset) {
+  return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// Maps the bundle and checks it against the sources; empty on any mismatch
+std::vector<Texture*> mapBundle(const std::vector<TextureSource>& sources, const std::string& bundlePath) {
+  int fd = open(bundlePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return {};
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(BundleHeader)) {
+    close(fd);
+    return {};
+  }
+  size_t size = info.st_size;
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return {};
+  }
+
+  const char* base = static_cast<const char*>(mapping);
+  const BundleHeader* header = reinterpret_cast<const BundleHeader*>(base);
+  bool ok = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+            header->version == VERSION &&
+            header->colorSize == sizeof(Color) &&
+            header->count == sources.size() &&
+            header->count <= (size - sizeof(BundleHeader)) / sizeof(BundleEntry);
+
+  std::vector<Texture*> textures;
+  const BundleEntry* entries = reinterpret_cast<const BundleEntry*>(base + sizeof(BundleHeader));
+  for (size_t i = 0; ok && i < sources.size(); i++) {
+    const BundleEntry& entry = entries[i];
+    int64_t sourceSize, sourceTime;
+    ok = sources[i].path == std::string(entry.source, strnlen(entry.source, sizeof(entry.source))) &&
+         sourceStamp(sources[i].path, sourceSize, sourceTime) &&
+         sourceSize == entry.sourceSize && sourceTime == entry.sourceTime &&
+         entry.levelsOffset <= size && entry.levelCount <= (size - entry.levelsOffset) / sizeof(BundleLevel) &&
+         entry.texelsOffset <= size && entry.texelCount <= (size - entry.texelsOffset) / sizeof(Color) &&
+         entry.levelsOffset % alignof(BundleLevel) == 0 && entry.texelsOffset % alignof(Color) == 0;
+    if (!ok) {
+      break;
+    }
+    if (!entry.valid) {
+      textures.push_back(nullptr);
+      continue;
+    }
+
+    const BundleLevel* stored = reinterpret_cast<const BundleLevel*>(base + entry.levelsOffset);
+    std::vector<Texture::Level> levels;
+    for (uint32_t l = 0; l < entry.levelCount; l++) {
+      levels.push_back({stored[l].width, stored[l].height, stored[l].tilesPerRow, stored[l].offset});
+    }
+    // A mip chain runs down to 1x1, otherwise only the base level is stored
+    ok = Texture::fits(levels, entry.texelCount) &&
+         (sources[i].mipmapped ? levels.back().width == 1 && levels.back().height == 1 : levels.size() == 1);
+    if (!ok) {
+      break;
+    }
+    textures.push_back(new Texture(levels, reinterpret_cast<const Color*>(base + entry.texelsOffset)));
+  }
+
+  if (!ok) {
+    for (Texture* texture : textures) {
+      delete texture;
+    }
+    munmap(mapping, size);
+    return {};
+  }
+  // The mapping backs the textures for the rest of the program
+  return textures;
+}
+
+bool writeBundle(const std::vector<TextureSource>& sources, const std::vector<Texture*>& textures, const std::string& bundlePath) {
+  std::vector<BundleEntry> entries(sources.size());
+  size_t offset = sizeof(BundleHeader) + entries.size() * sizeof(BundleEntry);
+  for (size_t i = 0; i < sources.size(); i++) {
+    BundleEntry& entry = entries[i];
+    std::memset(&entry, 0, sizeof(entry));
+    std::strncpy(entry.source, sources[i].path.c_str(), sizeof(entry.source) - 1);
+    sourceStamp(sources[i].path, entry.sourceSize, entry.sourceTime);
+    if (!textures[i]) {
+      continue;
+    }
+    entry.valid = 1;
+    entry.levelCount = textures[i]->levels();
+    entry.levelsOffset = offset;
+    offset += entry.levelCount * sizeof(BundleLevel);
+    entry.texelsOffset = offset = align(offset);
+    entry.texelCount = textures[i]->texelCount();
+    offset += entry.texelCount * sizeof(Color);
+  }
+
+  // Write next to the target and rename, so readers never see half a bundle
+  std::string temporary = bundlePath + ".tmp";
+  FILE* file = std::fopen(temporary.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+
+  BundleHeader header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.colorSize = sizeof(Color);
+  header.count = sources.size();
+  header.reserved = 0;
+
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(entries.data(), sizeof(BundleEntry), entries.size(), file) == entries.size();
+  for (size_t i = 0; ok && i < sources.size(); i++) {
+    if (!entries[i].valid) {
+      continue;
+    }
+    for (const Texture::Level& level : textures[i]->levelInfo()) {
+      BundleLevel stored{level.width, level.height, level.tilesPerRow, 0, level.offset};
+      ok = ok && std::fwrite(&stored, sizeof(stored), 1, file) == 1;
+    }
+    long position = std::ftell(file);
+    std::vector<char> padding(entries[i].texelsOffset - position, 0);
+    ok = ok && std::fwrite(padding.data(), 1, padding.size(), file) == padding.size() &&
+         std::fwrite(textures[i]->data(), sizeof(Color), entries[i].texelCount, file) == entries[i].texelCount;
+  }
+
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok || std::rename(temporary.c_str(), bundlePath.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+}
+
+std::vector<Texture*> buildBundle(const std::vector<TextureSource>& sources, const std::string& bundlePath) {
+  IMG_Init(IMG_INIT_PNG);
+
+  std::vector<std::future<Texture*>> decoding;
+  for (const TextureSource& source : sources) {
+    decoding.push_back(std::async(std::launch::async, loadTexture, source.path, source.mipmapped));
+  }
+
+  std::vector<Texture*> textures;
+  for (auto& texture : decoding) {
+    textures.push_back(texture.get());
+  }
+
+  if (!writeBundle(sources, textures, bundlePath)) {
+    print("Unable to write asset bundle", bundlePath);
+  }
+  return textures;
+}
+
+std::vector<Texture*> loadTextures(const std::vector<TextureSource>& sources, const std::string& bundlePath) {
+  std::vector<Texture*> textures = mapBundle(sources, bundlePath);
+  if (!textures.empty()) {
+    return textures;
+  }
+  print("Asset bundle missing or stale, decoding textures");
+  return buildBundle(sources, bundlePath);
+}
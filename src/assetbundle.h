@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "texture.h"
+
+// Pre-decoded textures for fast startup. The bundle stores every texture's
+// mip chain already in the tiled layout Texture samples from, so loading it
+// is a single mmap: the returned textures point straight into the mapping.
+// Each entry remembers the size and nanosecond modification time of its
+// source image, and a bundle that no longer matches its sources is rebuilt.
+// So is a bundle whose tables point outside the file.
+
+// An image to bundle; without a mip chain only its base level is stored
+struct TextureSource {
+  std::string path;
+  bool mipmapped = true;
+};
+
+// Returns one texture per source, in order (nullptr for sources that failed
+// to decode). Uses the bundle at bundlePath when it is current, otherwise
+// decodes the sources in parallel and writes a fresh bundle.
+std::vector<Texture*> loadTextures(const std::vector<TextureSource>& sources, const std::string& bundlePath);
+
+// Decodes every source in parallel and (re)writes the bundle.
+std::vector<Texture*> buildBundle(const std::vector<TextureSource>& sources, const std::string& bundlePath);
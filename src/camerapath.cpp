@@ -0,0 +1,81 @@
+#include "camerapath.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t) {
+  float t2 = t * t;
+  float t3 = t2 * t;
+  return 0.5f * ((2.0f * p1) +
+                 (p2 - p0) * t +
+                 (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                 (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+}
+
+CameraPath::CameraPath(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    throw std::runtime_error("Unable to open camera path: " + filename);
+  }
+
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+
+    std::istringstream in(line);
+    CameraKey key;
+    if (!(in >> key.time >> key.position.x >> key.position.y >> key.position.z
+             >> key.target.x >> key.target.y >> key.target.z)) {
+      throw std::runtime_error("Malformed camera key at " + filename + ":" + std::to_string(lineNumber));
+    }
+    keys.push_back(key);
+  }
+
+  if (keys.empty()) {
+    throw std::runtime_error("Camera path has no keys: " + filename);
+  }
+  std::stable_sort(keys.begin(), keys.end(), [](const CameraKey& a, const CameraKey& b) {
+    return a.time < b.time;
+  });
+}
+
+float CameraPath::duration() const {
+  return keys.back().time - keys.front().time;
+}
+
+Camera CameraPath::at(float time, const Camera& base) const {
+  time += keys.front().time;
+  if (keys.size() == 1 || time <= keys.front().time) {
+    return Camera(keys.front().position, keys.front().target, base.up, base.rotationSpeed);
+  }
+  if (time >= keys.back().time) {
+    return Camera(keys.back().position, keys.back().target, base.up, base.rotationSpeed);
+  }
+
+  // Segment [i, i + 1] contains time; the neighbours are clamped at the ends
+  size_t i = 0;
+  while (keys[i + 1].time < time) {
+    i++;
+  }
+  const CameraKey& k0 = keys[i == 0 ? 0 : i - 1];
+  const CameraKey& k1 = keys[i];
+  const CameraKey& k2 = keys[i + 1];
+  const CameraKey& k3 = keys[std::min(i + 2, keys.size() - 1)];
+
+  float span = k2.time - k1.time;
+  float t = span > 0 ? (time - k1.time) / span : 0.0f;
+  return Camera(catmullRom(k0.position, k1.position, k2.position, k3.position, t),
+                catmullRom(k0.target, k1.target, k2.target, k3.target, t),
+                base.up, base.rotationSpeed);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.h"
+
+struct CameraKey {
+  float time;
+  glm::vec3 position;
+  glm::vec3 target;
+};
+
+// Keyframed camera flythrough. The file holds one key per line as
+// "time px py pz tx ty tz"; blank lines and lines starting with # are skipped.
+// Positions and targets are interpolated with Catmull-Rom splines.
+class CameraPath {
+public:
+  CameraPath(const std::string& filename);
+
+  float duration() const;
+
+  // Camera at the given time; up and rotation speed are taken from base
+  Camera at(float time, const Camera& base) const;
+
+private:
+  std::vector<CameraKey> keys;
+};
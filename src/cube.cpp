@@ -1,5 +1,8 @@
 #include "cube.h"
 
+#include <array>
+#include <cmath>
+
 Cube::Cube(const glm::vec3& center, float side, const Material& mat)
   : center(center), side(side), half(side / 2.0f), Object(mat) {}
 
@@ -70,4 +73,34 @@ Intersect Cube::rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDir
     }
     return Intersect{true, tNear, point, normal, uv};
   }
-}
\ No newline at end of file
+}
+
+void Cube::bounds(glm::vec3& min, glm::vec3& max) const {
+  min = center - glm::vec3(half);
+  max = center + glm::vec3(half);
+}
+
+std::vector<Face> Cube::faces() const {
+  glm::vec3 low = center - glm::vec3(half);
+  glm::vec3 high = center + glm::vec3(half);
+  // Same order as the planes in rayIntersect: right, left, top, bottom, front, back
+  return {
+    Face{glm::vec3(high.x, low.y, low.z), glm::vec3(0.0f, 0.0f, side), glm::vec3(0.0f, side, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)},
+    Face{glm::vec3(low.x, low.y, low.z), glm::vec3(0.0f, 0.0f, side), glm::vec3(0.0f, side, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f)},
+    Face{glm::vec3(low.x, high.y, low.z), glm::vec3(side, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, side), glm::vec3(0.0f, 1.0f, 0.0f)},
+    Face{glm::vec3(low.x, low.y, low.z), glm::vec3(side, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, side), glm::vec3(0.0f, -1.0f, 0.0f)},
+    Face{glm::vec3(low.x, low.y, high.z), glm::vec3(side, 0.0f, 0.0f), glm::vec3(0.0f, side, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)},
+    Face{glm::vec3(low.x, low.y, low.z), glm::vec3(side, 0.0f, 0.0f), glm::vec3(0.0f, side, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)}
+  };
+}
+
+int Cube::faceOf(const Intersect& hit) const {
+  // The hit normal may point inwards, so the side is read off the hit point
+  int axis = 0;
+  for (int i = 1; i < 3; i++) {
+    if (std::abs(hit.normal[i]) > std::abs(hit.normal[axis])) {
+      axis = i;
+    }
+  }
+  return axis * 2 + (hit.point[axis] > center[axis] ? 0 : 1);
+}
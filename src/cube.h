@@ -11,6 +11,13 @@ public:
 
   Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const override;
 
+  void bounds(glm::vec3& min, glm::vec3& max) const override;
+  std::vector<Face> faces() const override;
+  int faceOf(const Intersect& hit) const override;
+
+  const glm::vec3& getCenter() const { return center; }
+  float getSide() const { return side; }
+
 private:
   glm::vec3 center;
   float side;
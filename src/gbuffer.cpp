@@ -0,0 +1,75 @@
+#include "gbuffer.h"
+
+#include <unordered_map>
+#include "raytracer.h"
+#include "visibilitybuffer.h"
+
+GBuffer::GBuffer(int width, int height)
+  : width(width), height(height), samples(width * height) {}
+
+bool GBuffer::matches(const Camera& camera) const {
+  return valid && camera.position == position && camera.target == target && camera.up == up;
+}
+
+void GBuffer::capture(const Camera& camera, ThreadPool& pool, const VisibilityBuffer* primary) {
+  position = camera.position;
+  target = camera.target;
+  up = camera.up;
+  Viewport view(camera, width, height);
+
+  std::unordered_map<const Object*, int> ids;
+  for (size_t i = 0; i < objects.size(); i++) {
+    ids[objects[i]] = i;
+  }
+
+  pool.parallelFor(height, [&](int y) {
+    std::vector<Object*> visible;
+    if (!primary) {
+      visible = frustumCull(view, objects, 0, y, width, 1);
+    }
+    for (int x = 0; x < width; x++) {
+      Hit hit;
+      if (primary) {
+        hit = primary->hit(x, y);
+      } else {
+        rayStats.primary.fetch_add(1, std::memory_order_relaxed);
+        rayStats.primaryTests.fetch_add(visible.size(), std::memory_order_relaxed);
+        hit = traceClosest(visible, view.origin, view.rayDirection(x, y));
+      }
+
+      Sample& sample = samples[y * width + x];
+      sample.material = hit.intersect.isIntersecting ? ids.at(hit.object) : -1;
+      sample.position = hit.intersect.point;
+      sample.normal = hit.intersect.normal;
+      sample.uv = hit.intersect.uv;
+      sample.dist = hit.intersect.dist;
+    }
+  });
+
+  captured++;
+  valid = true;
+  stale = true;
+}
+
+void GBuffer::shade(Color* out, ThreadPool& pool) {
+  Viewport view(Camera(position, target, up, 0.0f), width, height);
+
+  pool.parallelFor(height, [&](int y) {
+    for (int x = 0; x < width; x++) {
+      const Sample& sample = samples[y * width + x];
+      glm::vec3 rayDirection = view.rayDirection(x, y);
+      if (sample.material < 0) {
+        out[y * width + x] = sampleSkybox(rayDirection);
+        continue;
+      }
+
+      Hit hit;
+      hit.object = objects[sample.material];
+      hit.intersect = Intersect{true, sample.dist, sample.position, sample.normal, sample.uv};
+      out[y * width + x] = ::shade(hit, view.origin, rayDirection, 0, 1.0f, view.cone, pixelPath(x, y));
+    }
+  });
+
+  shaded++;
+  stale = false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.h"
+#include "color.h"
+#include "threadpool.h"
+
+class VisibilityBuffer;
+
+// Per-pixel primary hits of one view: position, normal, UV, distance and the
+// material ID, which is the index of the hit object in the scene so its
+// current Material is read at shading time. While the camera and geometry
+// stay put, edits to the light or to materials only re-run shading, with its
+// shadow and secondary rays, from the stored hits instead of tracing the
+// camera rays again.
+class GBuffer {
+public:
+  GBuffer(int width, int height);
+
+  // False when the stored hits are not the ones camera would see
+  bool matches(const Camera& camera) const;
+
+  // Stores the primary hits of camera, taken from primary when given,
+  // otherwise traced. Both passes run rows on pool and must not be called
+  // from a pool task.
+  void capture(const Camera& camera, ThreadPool& pool, const VisibilityBuffer* primary = nullptr);
+
+  // Lights every pixel from the stored hits
+  void shade(Color* out, ThreadPool& pool);
+
+  // Call after a light or material edit; the hits stay valid
+  void relight() { stale = true; }
+  // Call after the camera or geometry changes; the next frame captures the
+  // hits again
+  void invalidate() { valid = false; }
+
+  // Whether the frame shaded last is out of date
+  bool needsShading() const { return stale; }
+
+  long captured = 0;
+  long shaded = 0;
+
+private:
+  struct Sample {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+    float dist = 0.0f;
+    int material = -1;  // index into the scene, -1 when the ray escapes
+  };
+
+  int width;
+  int height;
+  bool valid = false;
+  bool stale = true;
+  glm::vec3 position;
+  glm::vec3 target;
+  glm::vec3 up;
+  std::vector<Sample> samples;
+};
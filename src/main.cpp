@@ -1,6 +1,8 @@
 #include <SDL2/SDL.h>
 #include <SDL_events.h>
 #include <SDL_render.h>
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <glm/ext/quaternion_geometric.hpp>
 #include <glm/geometric.hpp>
@@ -10,27 +12,32 @@
 #include <print.h>
 
 #include "color.h"
-#include "intersect.h"
-#include "object.h"
-#include "sphere.h"
-#include "cube.h"
-#include "light.h"
 #include "camera.h"
-#include "skybox.h"
+#include "cube.h"
+#include "gbuffer.h"
+#include "raytracer.h"
+#include "renderfarm.h"
+#include "animation.h"
+#include "poster.h"
+#include "renderservice.h"
+#include "scenecompiler.h"
+#include "temporalcache.h"
+#include "threadpool.h"
+#include "visibilitybuffer.h"
 
 const int SCREEN_WIDTH = 500;
 const int SCREEN_HEIGHT = 300;
-const float ASPECT_RATIO = static_cast<float>(SCREEN_WIDTH) / static_cast<float>(SCREEN_HEIGHT);
-const int MAX_RECURSION = 4;
-const float BIAS = 0.0001f;
-
-Skybox skybox("assets/textures");
 std::mutex pointMutex;
 
 SDL_Renderer* renderer;
-std::vector<Object*> objects;
-Light light(glm::vec3(0, 5, 6), 6.0f, Color(255, 255, 255));
 Camera camera(glm::vec3(0.0, 5.0, 6.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 4.0f, 0.0f), 10.0f);
+std::vector<Color> framebuffer(SCREEN_WIDTH * SCREEN_HEIGHT);
+TemporalCache temporalCache(SCREEN_WIDTH, SCREEN_HEIGHT);
+bool useTemporalCache = true;
+VisibilityBuffer visibility(SCREEN_WIDTH, SCREEN_HEIGHT);
+bool useRasterizer = true;
+GBuffer gbuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
+bool useGBuffer = false;
 
 
 void point(glm::vec2 position, Color color) {
@@ -38,308 +45,415 @@ void point(glm::vec2 position, Color color) {
     SDL_RenderDrawPoint(renderer, position.x, position.y);
 }
 
-float castShadow(const glm::vec3& point, const glm::vec3& lightDir, const Object* hitObject) {
-  float tNearShadow = INFINITY;
-  for (const auto& object : objects) {
-    if (object != hitObject) {
-        float t = object->rayIntersect(point + lightDir * BIAS, lightDir).dist;
-        if (t < tNearShadow) {
-            tNearShadow = t;
-        }
+void moveLight(const glm::vec3& delta) {
+    light.position += delta;
+    if (useShadowCache) {
+        shadowCache.lightMoved(objects, light.position);
     }
-  }
-  return tNearShadow < 1 ? 0.5f : 1.0f;
+    temporalCache.invalidate();
+    gbuffer.relight();
 }
 
-Color sampleSkybox(const glm::vec3& direction) {
-    // Convert direction vector to spherical coordinates
-    float theta = atan2(direction.z, direction.x);
-    float phi = acos(direction.y);
-    
-    // Convert spherical coordinates to texture coordinates
-    float u = theta / (2 * M_PI) + 0.5f;
-    float v = phi / M_PI;
+void scaleLight(float factor) {
+    light.intensity *= factor;
+    temporalCache.invalidate();
+    gbuffer.relight();
+}
 
-    // Sample the skybox texture at the calculated coordinates
-    return skybox.sample(u, v);
+// Shared by everything the window shades each frame
+ThreadPool& renderPool() {
+    static ThreadPool pool;
+    return pool;
 }
 
-Color castRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion = 0) {
-    float zBuffer = 99999;
-    Object* hitObject = nullptr;
-    Intersect intersect;
-
-    for (const auto& object : objects) {
-        Intersect i = object->rayIntersect(rayOrigin, rayDirection);
-        if (i.isIntersecting && i.dist < zBuffer) {
-            zBuffer = i.dist;
-            hitObject = object;
-            intersect = i;
-        }
+// Call after adding or removing objects
+void sceneChanged() {
+    if (useShadowCache) {
+        shadowCache.update(objects, renderPool());
     }
+    temporalCache.invalidate();
+    gbuffer.invalidate();
+}
 
-    if (!intersect.isIntersecting || recursion == MAX_RECURSION) {
-        return sampleSkybox(rayDirection);
-
+Object* placedBlock = nullptr;
+
+// Drops a block of whatever lies beneath onto the middle of the floor, or
+// takes it away again
+void toggleBlock() {
+    if (placedBlock) {
+        objects.erase(std::remove(objects.begin(), objects.end(), placedBlock), objects.end());
+        delete placedBlock;
+        placedBlock = nullptr;
+    } else {
+        glm::vec3 spot(0.0f, 1.0f, -2.0f);
+        Hit below = traceClosest(objects, spot, glm::vec3(0.0f, -1.0f, 0.0f));
+        if (!below.intersect.isIntersecting) {
+            return;
+        }
+        placedBlock = new Cube(spot, 1.0f, below.object->material);
+        objects.push_back(placedBlock);
     }
+    sceneChanged();
+}
 
-    glm::vec3 lightDir = glm::normalize(light.position - intersect.point);
-    glm::vec3 viewDir = glm::normalize(rayOrigin - intersect.point);
-    glm::vec3 reflectDir = glm::reflect(-lightDir, intersect.normal); 
-
-    // Add a small bias to the origin of the shadow ray
-    float shadowIntensity = castShadow(intersect.point + intersect.normal * BIAS, lightDir, hitObject);
-
-    float diffuseLightIntensity = std::max(0.0f, glm::dot(intersect.normal, lightDir));
-    float specReflection = glm::dot(viewDir, reflectDir);
-    
-    Material mat = hitObject->material;
-
-    float specLightIntensity = std::pow(std::max(0.0f, glm::dot(viewDir, reflectDir)), mat.specularCoefficient);
-
-
-    Color reflectedColor(0.0f, 0.0f, 0.0f);
-    if (mat.reflectivity > 0) {
-        glm::vec3 origin = intersect.point + intersect.normal * BIAS;
-        reflectedColor = castRay(origin, reflectDir, recursion + 1); 
+void render() {
+    bool primaryPass = useRasterizer && !(useGBuffer && gbuffer.matches(camera));
+    if (primaryPass) {
+        visibility.rasterize(Viewport(camera, SCREEN_WIDTH, SCREEN_HEIGHT), objects, renderPool());
     }
 
-    Color refractedColor(0.0f, 0.0f, 0.0f);
-    if (mat.transparency > 0) {
-        glm::vec3 normal = intersect.normal;
-        float refractionIndex = mat.refractionIndex;
-        if (glm::dot(rayDirection, normal) > 0) {
-            normal = -normal;
-            refractionIndex = 1 / refractionIndex;
+    if (useGBuffer) {
+        // Light and material edits keep the primary hits, only shading runs again
+        if (!gbuffer.matches(camera)) {
+            gbuffer.capture(camera, renderPool(), useRasterizer ? &visibility : nullptr);
         }
-        glm::vec3 refractDir = glm::refract(rayDirection, normal, refractionIndex);
-        refractedColor = castRay(intersect.point - normal * BIAS, refractDir, recursion + 1);
+        if (gbuffer.needsShading()) {
+            gbuffer.shade(framebuffer.data(), renderPool());
+        }
+    } else if (useTemporalCache) {
+        temporalCache.render(camera, framebuffer.data(), renderPool(), useRasterizer ? &visibility : nullptr);
+    } else if (useRasterizer) {
+        shadeVisible(visibility, framebuffer.data(), renderPool());
+    } else {
+        renderTile(camera, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, framebuffer.data());
     }
 
-    // Sample the color from the texture
-    int x = intersect.uv.x * (mat.texture->w - 1);
-    int y = intersect.uv.y * (mat.texture->h - 1);
-    SDL_Color colorTexture;
-    int bpp = mat.texture->format->BytesPerPixel;
-    Uint8 *p = (Uint8 *)mat.texture->pixels + y * mat.texture->pitch + x * bpp;
-    Uint32 pixel;
-    switch (bpp) {
-            case 1:
-                pixel = *p;
-                break;
-            case 2:
-                pixel = *(Uint16 *)p;
-                break;
-            case 3:
-                if (SDL_BYTEORDER == SDL_BIG_ENDIAN) {
-                    pixel = p[0] << 16 | p[1] << 8 | p[2];
-                } else {
-                    pixel = p[0] | p[1] << 8 | p[2] << 16;
-                }
-                break;
-            case 4:
-                pixel = *(Uint32 *)p;
-                break;
-            default:
-                throw std::runtime_error("Unknown format!");
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            point(glm::vec2(x, y), framebuffer[y * SCREEN_WIDTH + x]);
         }
-    SDL_GetRGB(pixel, mat.texture->format, &colorTexture.r, &colorTexture.g, &colorTexture.b);
-    Color textureColor(colorTexture.r, colorTexture.g, colorTexture.b);
-
-    Color diffuseLight = textureColor * light.intensity * diffuseLightIntensity * mat.albedo * shadowIntensity;
-    Color specularLight = light.color * light.intensity * specLightIntensity * mat.specularAlbedo * shadowIntensity;
-    Color color = (diffuseLight + specularLight) * (1.0f - mat.reflectivity - mat.transparency) + reflectedColor * mat.reflectivity + refractedColor * mat.transparency;
-    return color;
-} 
-
-void setUp() {
-    Material wood = {
-        nullptr, // Load the texture here
-        0.5,
-        0.04,
-        50.0f,
-        0.02f,
-        0.0f,
-        1.54
-    };
-
-    wood.texture = IMG_Load("assets/wood.png");
-    if (!wood.texture) {
-        print("Error loading texture");
     }
+}
 
-    Material stone = {
-        nullptr, // Load the texture here
-        0.6,
-        0.1,
-        10.0f,
-        0.05f,
-        0.0f,
-        1.54
-    };
-
-    stone.texture = IMG_Load("assets/stone.png");
-    if (!stone.texture) {
-        print("Error loading texture");
-    }
+// Rasterizes one frame and checks every primary hit against the tracer
+int verifyRasterizer() {
+    setUp();
+    Viewport view(camera, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    // Both passes run on the same pool, so the times compare the methods
+    auto start = std::chrono::steady_clock::now();
+    visibility.rasterize(view, objects, renderPool());
+    float rasterized = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    long tests = rayStats.primaryTests;
+
+    start = std::chrono::steady_clock::now();
+    int mismatches = visibility.verify(renderPool());
+    float traced = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+    print("visibility buffer:", rasterized * 1000.0f, "ms,", tests / float(SCREEN_WIDTH * SCREEN_HEIGHT),
+          "objects tested per pixel; tracing:", traced * 1000.0f, "ms,", objects.size(), "per pixel");
+    print("pixels differing from the tracer:", mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
 
-    Material gold = {
-        nullptr, // Load the texture here
-        1.5f,
-        0.4f,
-        200.0f,
-        0.4f,
-        0.0f,
-        0.47f
+// Steps the camera the way the arrow keys do, rendering each view through the
+// temporal cache and tracing it afresh, and reports how far the two differ.
+// Reused shadow factors may still miss a sliver of shadow, so this reports
+// the difference rather than failing on it.
+int verifyTemporal() {
+    setUp();
+    std::vector<Color> traced(SCREEN_WIDTH * SCREEN_HEIGHT);
+    auto renderCached = [&]() {
+        if (useRasterizer) {
+            visibility.rasterize(Viewport(camera, SCREEN_WIDTH, SCREEN_HEIGHT), objects, renderPool());
+        }
+        temporalCache.render(camera, framebuffer.data(), renderPool(), useRasterizer ? &visibility : nullptr);
     };
-
-    gold.texture = IMG_Load("assets/gold.png");
-    if (!gold.texture) {
-        print("Error loading texture");
+    renderCached();
+    temporalCache.reused = 0;
+    temporalCache.shaded = 0;
+
+    const int STEPS = 8;
+    long differing = 0;
+    int largest = 0;
+    for (int step = 0; step < STEPS; step++) {
+        if (step % 2 == 0) {
+            camera.rotate(1.0f, 0.0f);
+        } else {
+            camera.move(step < STEPS / 2 ? 1.0f : -1.0f);
+        }
+        renderCached();
+        renderTile(camera, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, traced.data());
+
+        for (size_t i = 0; i < traced.size(); i++) {
+            const Color& a = traced[i];
+            const Color& b = framebuffer[i];
+            int difference = std::max({std::abs(a.r - b.r), std::abs(a.g - b.g), std::abs(a.b - b.b)});
+            differing += difference > 0;
+            largest = std::max(largest, difference);
+        }
     }
 
-    Material water = {
-        nullptr, // Load the texture here
-        0.9,
-        0.95,
-        1000.0f,
-        0.1f,
-        0.55f,
-        1.0f
-    };
+    print("shadow factors per frame - reused:", temporalCache.reused / STEPS, "cast:", temporalCache.shaded / STEPS);
+    print("pixels differing from a fresh trace:", differing, "over", STEPS, "frames, largest difference:", largest);
+    return 0;
+}
 
-    water.texture = IMG_Load("assets/water.png");
-    if (!water.texture) {
-        print("Error loading texture");
+// Places and removes a block a few times, checking after each edit that the
+// lightmaps re-baked for it match a bake of the whole scene from scratch
+int verifyShadowEdits() {
+    useShadowCache = true;
+    setUp();
+    long faces = shadowCache.bakedFaces;
+
+    const int EDITS = 4;
+    long stale = 0;
+    shadowCache.bakedFaces = 0;
+    for (int edit = 0; edit < EDITS; edit++) {
+        toggleBlock();
+        ShadowCache fresh;
+        fresh.texelsPerUnit = shadowCache.texelsPerUnit;
+        fresh.bake(objects, light.position, renderPool());
+        stale += shadowCache.differingTexels(fresh);
     }
 
-    Material dirt = {
-        nullptr, // Load the texture here
-        0.5,
-        0.05,
-        10.0f,
-        0.05f,
-        0.0f,
-        1.54f
-    };
+    print("faces re-baked per edit:", shadowCache.bakedFaces / EDITS, "of", faces);
+    print("lightmap texels differing from a full bake:", stale);
+    return stale == 0 ? 0 : 1;
+}
 
-    dirt.texture = IMG_Load("assets/dirt.png");
-    if (!dirt.texture) {
-        print("Error loading texture");
+// Traces every pixel of a few views, plus a mirror and a light ray from each
+// hit, through both the compiled and the original scene and compares the hits
+int verifyMerge() {
+    mergeVoxelFaces = false;
+    setUp();
+    std::vector<Object*> compiled = compileScene(objects);
+
+    const int VIEWS = 8;
+    Camera orbit = camera;
+    long mismatches = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int v = 0; v < VIEWS; v++) {
+        mismatches += verifyCompiledScene(objects, compiled, Viewport(orbit, SCREEN_WIDTH, SCREEN_HEIGHT), light.position);
+        orbit.rotate(360.0f / VIEWS, 0.0f);
     }
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
 
-    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -1.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -2.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -3.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -2.0f), 1.0f, water));
-    objects.push_back(new Cube(glm::vec3(-3.0f, -1.0f, -2.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -1.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -3.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -1.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -2.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -3.0f), 1.0f, stone));
-    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(-1.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(-1.0f, 0.0f, -3.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(-1.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -1.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -2.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -3.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -1.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -2.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -3.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -1.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -2.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -3.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -1.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -2.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -3.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -1.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -2.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -3.0f), 1.0f, dirt));
-    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -4.0f), 1.0f, dirt));
-
-    objects.push_back(new Cube(glm::vec3(-2.0f, 1.0f, -4.0f), 1.0f, gold));
-    objects.push_back(new Cube(glm::vec3(-2.0f, 2.0f, -4.0f), 1.0f, gold));
-    objects.push_back(new Cube(glm::vec3(-1.0f, -1.0f, -1.0f), 1.0f, gold));
-    objects.push_back(new Cube(glm::vec3(-1.0f, -1.0f, -2.0f), 1.0f, gold));
-
-    objects.push_back(new Cube(glm::vec3(1.0f, 1.0f, -1.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(1.0f, 2.0f, -1.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(1.0f, 3.0f, -1.0f), 1.0f, wood));
-
-    objects.push_back(new Cube(glm::vec3(1.0f, 3.0f, -2.0f), 1.0f, wood));
-
-    objects.push_back(new Cube(glm::vec3(1.0f, 1.0f, -3.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(1.0f, 2.0f, -3.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(1.0f, 3.0f, -3.0f), 1.0f, wood));
-
-    objects.push_back(new Cube(glm::vec3(2.0f, 3.0f, -1.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(2.0f, 3.0f, -2.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(2.0f, 3.0f, -3.0f), 1.0f, wood));
-
-    objects.push_back(new Cube(glm::vec3(3.0f, 1.0f, -1.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(3.0f, 2.0f, -1.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(3.0f, 3.0f, -1.0f), 1.0f, wood));
-
-    objects.push_back(new Cube(glm::vec3(3.0f, 3.0f, -2.0f), 1.0f, wood));
-
-    objects.push_back(new Cube(glm::vec3(3.0f, 1.0f, -3.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(3.0f, 2.0f, -3.0f), 1.0f, wood));
-    objects.push_back(new Cube(glm::vec3(3.0f, 3.0f, -3.0f), 1.0f, wood));
+    print("compiled", objects.size(), "objects into", compiled.size(), "and checked", VIEWS, "views in", seconds, "s");
+    print("rays hitting differently:", mismatches);
+    return mismatches == 0 ? 0 : 1;
 }
 
-void render() {
-    float fov = 3.1415/3;
-    #pragma omp parallel for
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-
-            float screenX = (2.0f * (x + 0.5f)) / SCREEN_WIDTH - 1.0f;
-            float screenY = -(2.0f * (y + 0.5f)) / SCREEN_HEIGHT + 1.0f;
-            screenX *= ASPECT_RATIO;
-            screenX *= tan(fov/2.0f);
-            screenY *= tan(fov/2.0f);
+// Alternates light and material edits, shading each from the G-buffer and
+// tracing it in full, and compares the two images
+int benchmarkRelight() {
+    setUp();
+    std::vector<Color> traced(SCREEN_WIDTH * SCREEN_HEIGHT);
+    gbuffer.capture(camera, renderPool());
+
+    const int EDITS = 8;
+    float tracing = 0.0f;
+    float shading = 0.0f;
+    long differing = 0;
+    for (int edit = 0; edit < EDITS; edit++) {
+        if (edit % 2 == 0) {
+            moveLight(glm::vec3(edit % 4 == 0 ? 1.0f : -1.0f, 0.0f, 0.5f));
+            scaleLight(0.9f);
+        } else {
+            for (Object* object : objects) {
+                object->material.albedo *= 1.05f;
+                object->material.specularCoefficient += 1.0f;
+            }
+            gbuffer.relight();
+        }
+        if (useShadowCache && shadowCache.dirty()) {
+            shadowCache.update(objects, renderPool());
+        }
 
+        // Traced a row per task on the pool the G-buffer shades on, so the
+        // times differ only by the primary rays
+        auto start = std::chrono::steady_clock::now();
+        renderPool().parallelFor(SCREEN_HEIGHT, [&](int y) {
+            renderTile(camera, SCREEN_WIDTH, SCREEN_HEIGHT, 0, y, SCREEN_WIDTH, 1, traced.data() + y * SCREEN_WIDTH);
+        });
+        tracing += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        gbuffer.shade(framebuffer.data(), renderPool());
+        shading += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+        for (size_t i = 0; i < traced.size(); i++) {
+            const Color& a = traced[i];
+            const Color& b = framebuffer[i];
+            differing += a.r != b.r || a.g != b.g || a.b != b.b;
+        }
+    }
 
-            glm::vec3 cameraDir = glm::normalize(camera.target - camera.position);
+    print("per edit - full trace:", tracing * 1000.0f / EDITS, "ms, shading from the G-buffer:",
+          shading * 1000.0f / EDITS, "ms");
+    print("pixels differing from the full trace:", differing);
+    return differing == 0 ? 0 : 1;
+}
 
-            glm::vec3 cameraX = glm::normalize(glm::cross(cameraDir, camera.up));
-            glm::vec3 cameraY = glm::normalize(glm::cross(cameraX, cameraDir));
-            glm::vec3 rayDirection = glm::normalize(
-                cameraDir + cameraX * screenX + cameraY * screenY
-            );
-           
-            Color pixelColor = castRay(camera.position, rayDirection);
+int main(int argc, char* argv[]) {
+    FarmOptions farm;
+    BatchOptions batch;
+    PosterOptions poster;
+    ServiceOptions service;
+    bool farmMode = false;
+    bool serviceMode = false;
+    bool verifyRaster = false;
+    bool verifyMergeMode = false;
+    bool verifyTemporalMode = false;
+    bool verifyShadowMode = false;
+    bool benchRelight = false;
+    bool buildBundleMode = false;
+    std::string workerAddress;
+    std::string requestAddress;
+    int quality = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--farm") {
+            farmMode = true;
+        } else if (arg == "--no-temporal") {
+            useTemporalCache = false;
+        } else if (arg == "--no-shadow-cache") {
+            useShadowCache = false;
+        } else if (arg == "--no-merge") {
+            mergeVoxelFaces = false;
+        } else if (arg == "--no-raster") {
+            useRasterizer = false;
+        } else if (arg == "--verify-raster") {
+            verifyRaster = true;
+        } else if (arg == "--verify-merge") {
+            verifyMergeMode = true;
+        } else if (arg == "--verify-temporal") {
+            verifyTemporalMode = true;
+        } else if (arg == "--verify-shadow-edits") {
+            verifyShadowMode = true;
+        } else if (arg == "--gbuffer") {
+            useGBuffer = true;
+        } else if (arg == "--bench-relight") {
+            benchRelight = true;
+        } else if (arg == "--build-bundle") {
+            buildBundleMode = true;
+        } else if (!hasValue) {
+            print("Missing value for", arg);
+            return 1;
+        } else if (arg == "--cull-weight") {
+            rayPruning.cullWeight = std::stof(argv[++i]);
+        } else if (arg == "--roulette-weight") {
+            rayPruning.rouletteWeight = std::stof(argv[++i]);
+        } else if (arg == "--deep-weight") {
+            rayPruning.deepWeight = std::stof(argv[++i]);
+        } else if (arg == "--lightmap-res") {
+            shadowCache.texelsPerUnit = std::stoi(argv[++i]);
+        } else if (arg == "--texture-filter") {
+            std::string filter = argv[++i];
+            if (filter == "nearest") {
+                textureFilter = TextureFilter::Nearest;
+            } else if (filter == "bilinear") {
+                textureFilter = TextureFilter::Bilinear;
+            } else if (filter == "trilinear") {
+                textureFilter = TextureFilter::Trilinear;
+            } else {
+                print("Unknown texture filter", filter, "- use nearest, bilinear or trilinear");
+                return 1;
+            }
+        } else if (arg == "--worker") {
+            workerAddress = argv[++i];
+        } else if (arg == "--address") {
+            farm.address = argv[++i];
+        } else if (arg == "--workers") {
+            farm.workers = std::stoi(argv[++i]);
+        } else if (arg == "--width") {
+            farm.width = batch.width = poster.width = std::stoi(argv[++i]);
+        } else if (arg == "--height") {
+            farm.height = batch.height = poster.height = std::stoi(argv[++i]);
+        } else if (arg == "--tile") {
+            farm.tileSize = std::stoi(argv[++i]);
+        } else if (arg == "--frames") {
+            farm.frames = std::stoi(argv[++i]);
+        } else if (arg == "--orbit") {
+            farm.orbitStep = std::stof(argv[++i]);
+        } else if (arg == "--output") {
+            farm.output = argv[++i];
+        } else if (arg == "--die-after") {
+            farm.dieAfter = std::stoi(argv[++i]);
+        } else if (arg == "--camera-path") {
+            batch.pathFile = argv[++i];
+        } else if (arg == "--video") {
+            batch.output = argv[++i];
+        } else if (arg == "--fps") {
+            batch.fps = std::stof(argv[++i]);
+        } else if (arg == "--threads") {
+            batch.threads = poster.threads = service.threads = std::stoi(argv[++i]);
+        } else if (arg == "--frames-in-flight") {
+            batch.framesInFlight = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--poster") {
+            poster.output = argv[++i];
+        } else if (arg == "--band") {
+            poster.bandHeight = batch.bandHeight = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--serve") {
+            service.address = argv[++i];
+            serviceMode = true;
+        } else if (arg == "--max-queued-pixels") {
+            service.maxQueuedPixels = std::stol(argv[++i]);
+        } else if (arg == "--max-queued-requests") {
+            service.maxQueuedRequests = std::stoi(argv[++i]);
+        } else if (arg == "--tile-rows") {
+            service.tileRows = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--max-reply-backlog") {
+            service.maxReplyBacklog = std::stol(argv[++i]);
+        } else if (arg == "--max-requests") {
+            service.maxRequests = std::stoi(argv[++i]);
+        } else if (arg == "--request") {
+            requestAddress = argv[++i];
+        } else if (arg == "--quality") {
+            quality = std::stoi(argv[++i]);
+        }
+    }
 
-            point(glm::vec2(x, y), pixelColor);
+    // Headless modes never open a window
+    if (buildBundleMode) {
+        buildAssets();
+        return 0;
+    }
+    if (verifyRaster) {
+        return verifyRasterizer();
+    }
+    if (verifyMergeMode) {
+        return verifyMerge();
+    }
+    if (verifyTemporalMode) {
+        return verifyTemporal();
+    }
+    if (verifyShadowMode) {
+        return verifyShadowEdits();
+    }
+    if (benchRelight) {
+        return benchmarkRelight();
+    }
+    if (!requestAddress.empty()) {
+        return requestRender(requestAddress, camera, farm.width, farm.height, quality, farm.output);
+    }
+    if (!workerAddress.empty()) {
+        setUp();
+        return runWorker(workerAddress, farm.dieAfter);
+    }
+    if (farmMode) {
+        setUp();
+        return runCoordinator(farm, camera);
+    }
+    if (serviceMode) {
+        setUp();
+        return runService(service);
+    }
+    if (!poster.output.empty()) {
+        setUp();
+        return runPoster(poster, camera);
+    }
+    if (!batch.pathFile.empty()) {
+        // Keep log lines out of a video streamed to stdout
+        if (batch.output == "-") {
+            std::cout.rdbuf(std::cerr.rdbuf());
         }
+        setUp();
+        return runBatch(batch, camera);
     }
-}
 
-int main(int argc, char* argv[]) {
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
@@ -388,17 +502,42 @@ int main(int argc, char* argv[]) {
                 switch(event.key.keysym.sym) {
                     case SDLK_UP:
                         camera.move(1.0f);
+                        gbuffer.invalidate();
                         break;
                     case SDLK_DOWN:
                         camera.move(-1.0f);
+                        gbuffer.invalidate();
                         break;
                     case SDLK_LEFT:
                         print("left");
                         camera.rotate(-1.0f, 0.0f);
+                        gbuffer.invalidate();
                         break;
                     case SDLK_RIGHT:
                         print("right");
                         camera.rotate(1.0f, 0.0f);
+                        gbuffer.invalidate();
+                        break;
+                    case SDLK_j:
+                        moveLight(glm::vec3(-1.0f, 0.0f, 0.0f));
+                        break;
+                    case SDLK_l:
+                        moveLight(glm::vec3(1.0f, 0.0f, 0.0f));
+                        break;
+                    case SDLK_i:
+                        moveLight(glm::vec3(0.0f, 0.0f, -1.0f));
+                        break;
+                    case SDLK_k:
+                        moveLight(glm::vec3(0.0f, 0.0f, 1.0f));
+                        break;
+                    case SDLK_u:
+                        scaleLight(0.8f);
+                        break;
+                    case SDLK_o:
+                        scaleLight(1.25f);
+                        break;
+                    case SDLK_b:
+                        toggleBlock();
                         break;
                  }
             }
@@ -410,6 +549,11 @@ int main(int argc, char* argv[]) {
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
 
+        // Re-bake only the lightmaps the last light move or edit touched
+        if (useShadowCache && shadowCache.dirty()) {
+            shadowCache.update(objects, renderPool());
+        }
+
         render();
 
         // Present the renderer
@@ -422,6 +566,25 @@ int main(int argc, char* argv[]) {
             currentTime = SDL_GetTicks();
             std::string title = "Hello World - FPS: " + std::to_string(frameCount);
             SDL_SetWindowTitle(window, title.c_str());
+            print("rays/frame - primary:", rayStats.primary / frameCount,
+                  "objects tested per primary ray:", rayStats.primaryTests / std::max(1L, rayStats.primary.load()),
+                  "of", objects.size(),
+                  "secondary:", rayStats.secondary / frameCount,
+                  "shadow:", rayStats.shadow / frameCount,
+                  "culled:", rayStats.culled / frameCount,
+                  "roulette killed:", rayStats.rouletteKilled / frameCount,
+                  "roulette survived:", rayStats.rouletteSurvived / frameCount);
+            if (useGBuffer) {
+                print("G-buffer - captures:", gbuffer.captured, "shading passes:", gbuffer.shaded);
+                gbuffer.captured = 0;
+                gbuffer.shaded = 0;
+            } else if (useTemporalCache) {
+                print("shadow factors/frame - reused:", temporalCache.reused / frameCount,
+                      "cast:", temporalCache.shaded / frameCount);
+                temporalCache.reused = 0;
+                temporalCache.shaded = 0;
+            }
+            rayStats.reset();
             frameCount = 0;
         }
     }
@@ -1,16 +1,15 @@
 #pragma once
 
-#include <SDL.h>
-#include <SDL2/SDL_image.h>
-
 #include "color.h"
+#include "texture.h"
 
 struct Material {
-  SDL_Surface* texture; // Add this line
+  Texture* texture;
   float albedo;
   float specularAlbedo;
   float specularCoefficient;
   float reflectivity;
   float transparency;
   float refractionIndex;
+  short maxRecursion = 4; // deepest bounce that spawns rays off this material once they carry under RayPruning::deepWeight
 };
@@ -0,0 +1,138 @@
+#include "net.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+bool isTcp(const std::string& address) {
+  return !address.empty() && address[0] != '/' && address.find(':') != std::string::npos;
+}
+
+bool tcpAddress(const std::string& address, sockaddr_in& addr) {
+  size_t colon = address.rfind(':');
+  std::string host = address.substr(0, colon);
+  if (host.empty() || host == "localhost") {
+    host = "127.0.0.1";
+  }
+
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(std::stoi(address.substr(colon + 1))));
+  return inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1;
+}
+
+bool unixAddress(const std::string& address, sockaddr_un& addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (address.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::strcpy(addr.sun_path, address.c_str());
+  return true;
+}
+
+}
+
+int listenOn(const std::string& address) {
+  int fd;
+  if (isTcp(address)) {
+    sockaddr_in addr;
+    if (!tcpAddress(address, addr) || (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+      return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+  } else {
+    sockaddr_un addr;
+    if (!unixAddress(address, addr) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      return -1;
+    }
+    unlink(address.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+  }
+
+  if (listen(fd, 64) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int connectTo(const std::string& address) {
+  int fd;
+  if (isTcp(address)) {
+    sockaddr_in addr;
+    if (!tcpAddress(address, addr) || (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+      return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  } else {
+    sockaddr_un addr;
+    if (!unixAddress(address, addr) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+void closeListener(int fd, const std::string& address) {
+  close(fd);
+  if (!isTcp(address)) {
+    unlink(address.c_str());
+  }
+}
+
+bool readAll(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Addresses are either a filesystem path (Unix domain socket) or host:port
+// (TCP, meant for loopback). All functions return -1 / false on failure.
+int listenOn(const std::string& address);
+int connectTo(const std::string& address);
+void closeListener(int fd, const std::string& address);
+
+bool readAll(int fd, void* data, size_t size);
+bool writeAll(int fd, const void* data, size_t size);
@@ -1,13 +1,31 @@
 #pragma once
 
+#include <vector>
 #include <glm/glm.hpp>
 #include "material.h"
 #include "intersect.h"
 
+// Planar rectangle of an object's surface: origin + s * u + t * v, s and t in [0, 1]
+struct Face {
+  glm::vec3 origin;
+  glm::vec3 u;
+  glm::vec3 v;
+  glm::vec3 normal; // points out of the object
+};
+
 class Object {
 public:
   Object(const Material& mat) : material(mat) {}
+  virtual ~Object() = default;
   virtual Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const = 0;
-  
+
+  // Axis-aligned box enclosing the object
+  virtual void bounds(glm::vec3& min, glm::vec3& max) const = 0;
+
+  // Flat faces making up the surface; empty for curved objects
+  virtual std::vector<Face> faces() const { return {}; }
+  // Index into faces() of the face a hit on this object lies on, or -1
+  virtual int faceOf(const Intersect& hit) const { return -1; }
+
   Material material;
 };
@@ -0,0 +1,82 @@
+#include "poster.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <print.h>
+
+#include "ppm.h"
+#include "raytracer.h"
+#include "threadpool.h"
+
+int runPoster(const PosterOptions& options, const Camera& camera) {
+  const int width = options.width;
+  const int height = options.height;
+  const int bandHeight = std::max(1, std::min(options.bandHeight, height));
+  const int bands = (height + bandHeight - 1) / bandHeight;
+
+  PPMStream out;
+  if (!out.open(options.output, width, height)) {
+    print("Unable to open", options.output);
+    return 1;
+  }
+
+  ThreadPool pool(options.threads > 0 ? options.threads : std::thread::hardware_concurrency());
+
+  // One band being traced, and two packed bands so the previous one can
+  // still be on its way to disk while this one is packed
+  std::vector<Color> band(static_cast<size_t>(width) * bandHeight);
+  std::array<std::vector<Uint8>, 2> rgb;
+  rgb[0].resize(band.size() * 3);
+  rgb[1].resize(band.size() * 3);
+  std::thread writer;
+  bool written = true;
+
+  auto start = std::chrono::steady_clock::now();
+  int reported = 0;
+  for (int b = 0; b < bands; b++) {
+    int y0 = b * bandHeight;
+    int rows = std::min(bandHeight, height - y0);
+
+    // A row per task keeps every thread busy even on a thin band
+    pool.parallelFor(rows, [&](int row) {
+      renderTile(camera, width, height, 0, y0 + row, width, 1, band.data() + static_cast<size_t>(row) * width);
+    });
+
+    std::vector<Uint8>& packed = rgb[b % 2];
+    packRGB(band.data(), static_cast<size_t>(width) * rows, packed.data());
+
+    if (writer.joinable()) {
+      writer.join();
+    }
+    if (!written) {
+      break;
+    }
+    writer = std::thread([&out, &written, &packed, rows] {
+      written = out.write(packed.data(), rows);
+    });
+
+    int percent = (b + 1) * 100 / bands;
+    if (percent / 10 > reported / 10 || b + 1 == bands) {
+      reported = percent;
+      float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+      print("poster", percent, "% after", seconds, "s, about", seconds * (bands - b - 1) / (b + 1), "s left");
+    }
+  }
+
+  if (writer.joinable()) {
+    writer.join();
+  }
+  bool ok = out.close() && written;
+  if (!ok) {
+    print("Error writing", options.output);
+    return 1;
+  }
+
+  float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  float bufferMB = (band.size() * sizeof(Color) + rgb[0].size() * 2) / (1024.0f * 1024.0f);
+  print("Wrote", width, "x", height, "to", options.output, "in", seconds, "s using", bufferMB, "MB of band buffers");
+  return 0;
+}
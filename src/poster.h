@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include "camera.h"
+
+// Renders one very large still without holding the framebuffer: the image is
+// traced in bands of rows and every finished band is streamed to a binary
+// PPM while the next one traces. Memory stays at a few bands whatever the
+// resolution, e.g. 16384 x 16384 with 64-row bands needs about 10 MB.
+struct PosterOptions {
+  std::string output;
+  int width = 500;
+  int height = 300;
+  int bandHeight = 64;  // rows traced between writes
+  int threads = 0;      // 0 uses every core
+};
+
+int runPoster(const PosterOptions& options, const Camera& camera);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "color.h"
+
+// Packs colours into tightly packed 8-bit RGB triplets.
+inline void packRGB(const Color* pixels, size_t count, Uint8* out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i * 3 + 0] = pixels[i].r;
+        out[i * 3 + 1] = pixels[i].g;
+        out[i * 3 + 2] = pixels[i].b;
+    }
+}
+
+// Writes pixels as a binary PPM (P6) image.
+inline bool writePPM(const std::string& path, int width, int height, const Color* pixels) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    std::vector<Uint8> rgb(static_cast<size_t>(width) * height * 3);
+    packRGB(pixels, static_cast<size_t>(width) * height, rgb.data());
+
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool ok = std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// Writes a binary PPM (P6) image a band of rows at a time, top row first, so
+// the whole image never has to be held in memory.
+class PPMStream {
+public:
+    ~PPMStream() {
+        close();
+    }
+
+    bool open(const std::string& path, int width, int height) {
+        file = std::fopen(path.c_str(), "wb");
+        rowBytes = static_cast<size_t>(width) * 3;
+        return file && std::fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+    }
+
+    bool write(const Uint8* rgb, int rows) {
+        size_t bytes = rowBytes * rows;
+        return std::fwrite(rgb, 1, bytes, file) == bytes;
+    }
+
+    bool close() {
+        if (!file) {
+            return true;
+        }
+        bool ok = std::fclose(file) == 0;
+        file = nullptr;
+        return ok;
+    }
+
+private:
+    FILE* file = nullptr;
+    size_t rowBytes = 0;
+};
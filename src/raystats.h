@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Thresholds castRay uses to decide whether a secondary ray is worth tracing.
+// A ray's weight is the fraction of the pixel colour it can still contribute.
+struct RayPruning {
+  float cullWeight = 1.0f / 255.0f;     // rays below this are dropped outright
+  float rouletteWeight = 4.0f / 255.0f; // rays below this play Russian roulette
+  float deepWeight = 0.25f;             // rays at least this strong may bounce past a material's maxRecursion
+};
+
+struct RayStats {
+  std::atomic<long> primary{0};
+  std::atomic<long> primaryTests{0}; // object intersection tests spent on primary rays
+  std::atomic<long> secondary{0};
+  std::atomic<long> shadow{0};
+  std::atomic<long> culled{0};
+  std::atomic<long> rouletteKilled{0};
+  std::atomic<long> rouletteSurvived{0};
+
+  void reset() {
+    primary = 0;
+    primaryTests = 0;
+    secondary = 0;
+    shadow = 0;
+    culled = 0;
+    rouletteKilled = 0;
+    rouletteSurvived = 0;
+  }
+};
+
+// Names a ray by the pixel it started from and the bounces that led to it, so
+// Russian roulette decides the same way for it on every frame and in every
+// render mode. A primary ray is pixelPath(x, y), each bounce extends it.
+inline uint32_t hashPath(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x7feb352du;
+  h ^= h >> 15;
+  h *= 0x846ca68bu;
+  h ^= h >> 16;
+  return h;
+}
+
+inline uint32_t pixelPath(int x, int y) {
+  return hashPath(static_cast<uint32_t>(x) * 0x9e3779b9u ^ hashPath(static_cast<uint32_t>(y)));
+}
+
+enum RayBranch : uint32_t { REFLECTED = 1, REFRACTED = 2 };
+
+inline uint32_t bouncePath(uint32_t path, RayBranch branch) {
+  return hashPath(path * 4 + branch);
+}
+
+// Decides the fate of a secondary ray carrying `weight`, named by `path`.
+// Returns 0 if the ray should not be traced; otherwise returns the factor its
+// colour has to be scaled by and updates `weight` to the value the ray
+// continues with.
+inline float pruneRay(float& weight, uint32_t path, const RayPruning& pruning, RayStats& stats) {
+  if (weight < pruning.cullWeight) {
+    stats.culled.fetch_add(1, std::memory_order_relaxed);
+    return 0.0f;
+  }
+
+  if (weight < pruning.rouletteWeight) {
+    // Top 24 bits of the path as a uniform sample in [0, 1)
+    float sample = (path >> 8) * (1.0f / 16777216.0f);
+    float survival = weight / pruning.rouletteWeight;
+    if (sample >= survival) {
+      stats.rouletteKilled.fetch_add(1, std::memory_order_relaxed);
+      return 0.0f;
+    }
+    stats.rouletteSurvived.fetch_add(1, std::memory_order_relaxed);
+    weight = pruning.rouletteWeight;
+    return 1.0f / survival;
+  }
+
+  return 1.0f;
+}
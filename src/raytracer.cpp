@@ -0,0 +1,461 @@
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <glm/ext/quaternion_geometric.hpp>
+#include <glm/geometric.hpp>
+#include <glm/glm.hpp>
+#include <print.h>
+
+#include "raytracer.h"
+#include "cube.h"
+#include "skybox.h"
+#include "assetbundle.h"
+#include "scenecompiler.h"
+#include "threadpool.h"
+
+Skybox skybox;
+RayPruning rayPruning;
+RayStats rayStats;
+TextureFilter textureFilter = TextureFilter::Trilinear;
+ShadowCache shadowCache;
+bool useShadowCache = true;
+bool mergeVoxelFaces = true;
+
+std::vector<Object*> objects;
+Light light(glm::vec3(0, 5, 6), 6.0f, Color(255, 255, 255));
+
+float castShadow(const glm::vec3& point, const glm::vec3& lightDir, const Object* hitObject) {
+  return castShadow(objects, point, lightDir, hitObject);
+}
+
+float castShadow(const std::vector<Object*>& scene, const glm::vec3& point, const glm::vec3& lightDir, const Object* hitObject) {
+  rayStats.shadow.fetch_add(1, std::memory_order_relaxed);
+  float tNearShadow = INFINITY;
+  for (const auto& object : scene) {
+    if (object != hitObject) {
+        Intersect i = object->rayIntersect(point + lightDir * BIAS, lightDir);
+        if (i.isIntersecting && i.dist < tNearShadow) {
+            tNearShadow = i.dist;
+        }
+    }
+  }
+  return tNearShadow < SHADOW_REACH ? 0.5f : 1.0f;
+}
+
+Color sampleSkybox(const glm::vec3& direction) {
+    // Convert direction vector to spherical coordinates
+    float theta = atan2(direction.z, direction.x);
+    float phi = acos(direction.y);
+    
+    // Convert spherical coordinates to texture coordinates
+    float u = theta / (2 * M_PI) + 0.5f;
+    float v = phi / M_PI;
+
+    // Sample the skybox texture at the calculated coordinates
+    return skybox.sample(u, v);
+}
+
+Hit traceClosest(const std::vector<Object*>& scene, const glm::vec3& rayOrigin, const glm::vec3& rayDirection) {
+    float zBuffer = 99999;
+    Hit hit;
+
+    for (const auto& object : scene) {
+        Intersect i = object->rayIntersect(rayOrigin, rayDirection);
+        if (i.isIntersecting && i.dist < zBuffer) {
+            zBuffer = i.dist;
+            hit.object = object;
+            hit.intersect = i;
+        }
+    }
+    return hit;
+}
+
+Color castRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion, const float weight, const RayCone& cone, uint32_t path) {
+    Hit hit = traceClosest(objects, rayOrigin, rayDirection);
+
+    if (!hit.intersect.isIntersecting || recursion == MAX_RECURSION) {
+        return sampleSkybox(rayDirection);
+
+    }
+
+    return shade(hit, rayOrigin, rayDirection, recursion, weight, cone, path);
+}
+
+float shadowAt(const Hit& hit) {
+    const Intersect& intersect = hit.intersect;
+    float shadowIntensity;
+    if (!useShadowCache || !shadowCache.lookup(hit.object, intersect, shadowIntensity)) {
+        // Add a small bias to the origin of the shadow ray
+        glm::vec3 lightDir = glm::normalize(light.position - intersect.point);
+        shadowIntensity = castShadow(intersect.point + intersect.normal * BIAS, lightDir, hit.object);
+    }
+    return shadowIntensity;
+}
+
+Color shade(const Hit& hit, const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion, const float weight, const RayCone& cone, uint32_t path) {
+    return shade(hit, shadowAt(hit), rayOrigin, rayDirection, recursion, weight, cone, path);
+}
+
+Color shade(const Hit& hit, float shadowIntensity, const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion, const float weight, const RayCone& cone, uint32_t path) {
+    const Intersect& intersect = hit.intersect;
+    const Object* hitObject = hit.object;
+
+    glm::vec3 lightDir = glm::normalize(light.position - intersect.point);
+    glm::vec3 viewDir = glm::normalize(rayOrigin - intersect.point);
+    glm::vec3 reflectDir = glm::reflect(-lightDir, intersect.normal); 
+
+    float diffuseLightIntensity = std::max(0.0f, glm::dot(intersect.normal, lightDir));
+
+    Material mat = hitObject->material;
+
+    float specLightIntensity = std::pow(std::max(0.0f, glm::dot(viewDir, reflectDir)), mat.specularCoefficient);
+
+
+    float footprint = cone.width + cone.spread * intersect.dist;
+    RayCone secondaryCone{footprint, cone.spread};
+
+    // Secondary rays only get traced while what they carry can still show up in
+    // the pixel. Past the material's depth only rays still carrying a large
+    // share of the pixel go on, up to the global limit.
+    bool canRecurse = recursion < mat.maxRecursion ||
+                      (recursion < MAX_RECURSION && weight >= rayPruning.deepWeight);
+
+    Color reflectedColor(0.0f, 0.0f, 0.0f);
+    float reflectWeight = 0.0f;
+    if (mat.reflectivity > 0 && canRecurse) {
+        float rayWeight = weight * mat.reflectivity;
+        uint32_t reflectedPath = bouncePath(path, REFLECTED);
+        float compensation = pruneRay(rayWeight, reflectedPath, rayPruning, rayStats);
+        if (compensation > 0) {
+            rayStats.secondary.fetch_add(1, std::memory_order_relaxed);
+            glm::vec3 origin = intersect.point + intersect.normal * BIAS;
+            reflectedColor = castRay(origin, reflectDir, recursion + 1, rayWeight, secondaryCone, reflectedPath);
+            reflectWeight = mat.reflectivity * compensation;
+        }
+    }
+
+    Color refractedColor(0.0f, 0.0f, 0.0f);
+    float refractWeight = 0.0f;
+    if (mat.transparency > 0 && canRecurse) {
+        float rayWeight = weight * mat.transparency;
+        uint32_t refractedPath = bouncePath(path, REFRACTED);
+        float compensation = pruneRay(rayWeight, refractedPath, rayPruning, rayStats);
+        if (compensation > 0) {
+            rayStats.secondary.fetch_add(1, std::memory_order_relaxed);
+            glm::vec3 normal = intersect.normal;
+            float refractionIndex = mat.refractionIndex;
+            if (glm::dot(rayDirection, normal) > 0) {
+                normal = -normal;
+                refractionIndex = 1 / refractionIndex;
+            }
+            glm::vec3 refractDir = glm::refract(rayDirection, normal, refractionIndex);
+            refractedColor = castRay(intersect.point - normal * BIAS, refractDir, recursion + 1, rayWeight, secondaryCone, refractedPath);
+            refractWeight = mat.transparency * compensation;
+        }
+    }
+
+    // Sample the color from the texture, filtered over the pixel's footprint
+    Color textureColor = mat.texture->sample(intersect.uv, footprint, textureFilter);
+
+    Color diffuseLight = textureColor * light.intensity * diffuseLightIntensity * mat.albedo * shadowIntensity;
+    Color specularLight = light.color * light.intensity * specLightIntensity * mat.specularAlbedo * shadowIntensity;
+    Color color = (diffuseLight + specularLight) * (1.0f - mat.reflectivity - mat.transparency) + reflectedColor * reflectWeight + refractedColor * refractWeight;
+    return color;
+} 
+
+const std::string ASSET_BUNDLE = "assets/textures.bundle";
+
+std::vector<TextureSource> textureSources() {
+    // The skybox only reads the base level of its faces
+    std::vector<TextureSource> sources;
+    for (const std::string& face : Skybox::faceFiles("assets/textures")) {
+        sources.push_back({face, false});
+    }
+    sources.push_back({"assets/wood.png"});
+    sources.push_back({"assets/stone.png"});
+    sources.push_back({"assets/gold.png"});
+    sources.push_back({"assets/water.png"});
+    sources.push_back({"assets/dirt.png"});
+    return sources;
+}
+
+void buildAssets() {
+    buildBundle(textureSources(), ASSET_BUNDLE);
+}
+
+void setUp() {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<TextureSource> sources = textureSources();
+    std::vector<Texture*> textures = loadTextures(sources, ASSET_BUNDLE);
+    auto textureFor = [&](const std::string& path) {
+        auto source = std::find_if(sources.begin(), sources.end(), [&](const TextureSource& s) { return s.path == path; });
+        return textures[source - sources.begin()];
+    };
+
+    skybox = Skybox({textures[0], textures[1], textures[2], textures[3], textures[4], textures[5]});
+    print("Textures ready in", std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(), "ms");
+
+    Material wood = {
+        nullptr, // Load the texture here
+        0.5,
+        0.04,
+        50.0f,
+        0.02f,
+        0.0f,
+        1.54,
+        2
+    };
+
+    wood.texture = textureFor("assets/wood.png");
+
+    Material stone = {
+        nullptr, // Load the texture here
+        0.6,
+        0.1,
+        10.0f,
+        0.05f,
+        0.0f,
+        1.54,
+        2
+    };
+
+    stone.texture = textureFor("assets/stone.png");
+
+    Material gold = {
+        nullptr, // Load the texture here
+        1.5f,
+        0.4f,
+        200.0f,
+        0.4f,
+        0.0f,
+        0.47f,
+        3
+    };
+
+    gold.texture = textureFor("assets/gold.png");
+
+    Material water = {
+        nullptr, // Load the texture here
+        0.9,
+        0.95,
+        1000.0f,
+        0.1f,
+        0.55f,
+        1.0f,
+        3
+    };
+
+    water.texture = textureFor("assets/water.png");
+
+    Material dirt = {
+        nullptr, // Load the texture here
+        0.5,
+        0.05,
+        10.0f,
+        0.05f,
+        0.0f,
+        1.54f,
+        2
+    };
+
+    dirt.texture = textureFor("assets/dirt.png");
+
+    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -1.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -2.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -3.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-4.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -2.0f), 1.0f, water));
+    objects.push_back(new Cube(glm::vec3(-3.0f, -1.0f, -2.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -1.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -3.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-3.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -1.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -2.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -3.0f), 1.0f, stone));
+    objects.push_back(new Cube(glm::vec3(-2.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(-1.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(-1.0f, 0.0f, -3.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(-1.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -1.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -2.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -3.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(0.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -1.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -2.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -3.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(4.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -1.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -2.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -3.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(3.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -1.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -2.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -3.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(2.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -1.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -2.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -3.0f), 1.0f, dirt));
+    objects.push_back(new Cube(glm::vec3(1.0f, 0.0f, -4.0f), 1.0f, dirt));
+
+    objects.push_back(new Cube(glm::vec3(-2.0f, 1.0f, -4.0f), 1.0f, gold));
+    objects.push_back(new Cube(glm::vec3(-2.0f, 2.0f, -4.0f), 1.0f, gold));
+    objects.push_back(new Cube(glm::vec3(-1.0f, -1.0f, -1.0f), 1.0f, gold));
+    objects.push_back(new Cube(glm::vec3(-1.0f, -1.0f, -2.0f), 1.0f, gold));
+
+    objects.push_back(new Cube(glm::vec3(1.0f, 1.0f, -1.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(1.0f, 2.0f, -1.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(1.0f, 3.0f, -1.0f), 1.0f, wood));
+
+    objects.push_back(new Cube(glm::vec3(1.0f, 3.0f, -2.0f), 1.0f, wood));
+
+    objects.push_back(new Cube(glm::vec3(1.0f, 1.0f, -3.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(1.0f, 2.0f, -3.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(1.0f, 3.0f, -3.0f), 1.0f, wood));
+
+    objects.push_back(new Cube(glm::vec3(2.0f, 3.0f, -1.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(2.0f, 3.0f, -2.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(2.0f, 3.0f, -3.0f), 1.0f, wood));
+
+    objects.push_back(new Cube(glm::vec3(3.0f, 1.0f, -1.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(3.0f, 2.0f, -1.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(3.0f, 3.0f, -1.0f), 1.0f, wood));
+
+    objects.push_back(new Cube(glm::vec3(3.0f, 3.0f, -2.0f), 1.0f, wood));
+
+    objects.push_back(new Cube(glm::vec3(3.0f, 1.0f, -3.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(3.0f, 2.0f, -3.0f), 1.0f, wood));
+    objects.push_back(new Cube(glm::vec3(3.0f, 3.0f, -3.0f), 1.0f, wood));
+
+    if (mergeVoxelFaces) {
+        size_t cubes = objects.size();
+        objects = compileScene(objects);
+        print("Scene compiled from", cubes, "to", objects.size(), "objects");
+    }
+
+    if (useShadowCache) {
+        ThreadPool pool;
+        shadowCache.bake(objects, light.position, pool);
+    }
+}
+
+Viewport::Viewport(const Camera& camera, int width, int height)
+    : origin(camera.position), width(width), height(height) {
+    float fov = 3.1415/3;
+    aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+    tanHalfFov = tan(fov/2.0f);
+
+    forward = glm::normalize(camera.target - camera.position);
+    right = glm::normalize(glm::cross(forward, camera.up));
+    up = glm::normalize(glm::cross(right, forward));
+
+    // Angle one pixel subtends, so the hit footprint grows with distance
+    cone = RayCone{0.0f, 2.0f * tanHalfFov / height};
+}
+
+glm::vec3 Viewport::rayDirection(int x, int y) const {
+    float screenX = (2.0f * (x + 0.5f)) / width - 1.0f;
+    float screenY = -(2.0f * (y + 0.5f)) / height + 1.0f;
+    screenX *= aspectRatio;
+    screenX *= tanHalfFov;
+    screenY *= tanHalfFov;
+
+    return glm::normalize(forward + right * screenX + up * screenY);
+}
+
+bool Viewport::project(const glm::vec3& point, glm::vec2& pixel) const {
+    glm::vec3 d = point - origin;
+    float depth = glm::dot(d, forward);
+    if (depth <= 0) {
+        return false;
+    }
+    float screenX = glm::dot(d, right) / depth / (aspectRatio * tanHalfFov);
+    float screenY = glm::dot(d, up) / depth / tanHalfFov;
+    pixel.x = (screenX + 1.0f) * width / 2.0f - 0.5f;
+    pixel.y = (1.0f - screenY) * height / 2.0f - 0.5f;
+    return true;
+}
+
+std::vector<Object*> frustumCull(const Viewport& view, const std::vector<Object*>& scene, int x0, int y0, int w, int h) {
+    // Rays through the outer pixel edges of the block span its frustum
+    auto edgeRay = [&](float px, float py) {
+        float screenX = (2.0f * px / view.width - 1.0f) * view.aspectRatio * view.tanHalfFov;
+        float screenY = (1.0f - 2.0f * py / view.height) * view.tanHalfFov;
+        return view.forward + view.right * screenX + view.up * screenY;
+    };
+    glm::vec3 corners[4] = {
+        edgeRay(x0, y0), edgeRay(x0 + w, y0), edgeRay(x0 + w, y0 + h), edgeRay(x0, y0 + h)
+    };
+    glm::vec3 inside = edgeRay(x0 + w / 2.0f, y0 + h / 2.0f);
+
+    glm::vec3 planes[5];
+    for (int i = 0; i < 4; i++) {
+        planes[i] = glm::cross(corners[i], corners[(i + 1) % 4]);
+        if (glm::dot(planes[i], inside) < 0) {
+            planes[i] = -planes[i];
+        }
+    }
+    planes[4] = view.forward;
+
+    // Keep a box unless it lies entirely on the outer side of some plane; the
+    // scene order is preserved so ties resolve exactly as in a full traversal
+    std::vector<Object*> visible;
+    for (Object* object : scene) {
+        glm::vec3 min, max;
+        object->bounds(min, max);
+
+        bool outside = false;
+        for (const glm::vec3& normal : planes) {
+            glm::vec3 farthest(normal.x > 0 ? max.x : min.x,
+                               normal.y > 0 ? max.y : min.y,
+                               normal.z > 0 ? max.z : min.z);
+            if (glm::dot(normal, farthest - view.origin) < 0) {
+                outside = true;
+                break;
+            }
+        }
+        if (!outside) {
+            visible.push_back(object);
+        }
+    }
+    return visible;
+}
+
+Color castPrimaryRay(const std::vector<Object*>& visible, const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const RayCone& cone, uint32_t path) {
+    rayStats.primary.fetch_add(1, std::memory_order_relaxed);
+    rayStats.primaryTests.fetch_add(visible.size(), std::memory_order_relaxed);
+
+    Hit hit = traceClosest(visible, rayOrigin, rayDirection);
+    if (!hit.intersect.isIntersecting) {
+        return sampleSkybox(rayDirection);
+    }
+    return shade(hit, rayOrigin, rayDirection, 0, 1.0f, cone, path);
+}
+
+void renderTile(const Camera& camera, int width, int height, int x0, int y0, int w, int h, Color* out) {
+    Viewport view(camera, width, height);
+    std::vector<Object*> visible = frustumCull(view, objects, x0, y0, w, h);
+
+    #pragma omp parallel for
+    for (int y = y0; y < y0 + h; y++) {
+        for (int x = x0; x < x0 + w; x++) {
+            out[(y - y0) * w + (x - x0)] = castPrimaryRay(visible, view.origin, view.rayDirection(x, y), view.cone, pixelPath(x, y));
+        }
+    }
+}
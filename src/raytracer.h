@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "color.h"
+#include "object.h"
+#include "light.h"
+#include "camera.h"
+#include "raystats.h"
+#include "texture.h"
+#include "shadowcache.h"
+
+const int MAX_RECURSION = 4;
+const float BIAS = 0.0001f;
+// Occluders further than this along a shadow ray do not darken the surface
+const float SHADOW_REACH = 1.0f;
+
+extern std::vector<Object*> objects;
+extern Light light;
+extern RayPruning rayPruning;
+extern RayStats rayStats;
+extern TextureFilter textureFilter;
+extern ShadowCache shadowCache;
+extern bool useShadowCache;
+// setUp() compiles voxel cubes into merged exposed faces
+extern bool mergeVoxelFaces;
+
+// Width of the beam a ray stands for: `width` world units at its origin,
+// growing by `spread` for every unit travelled. Picks the texture mip level.
+struct RayCone {
+  float width = 0.0f;
+  float spread = 0.0f;
+};
+
+struct Hit {
+  Intersect intersect;
+  const Object* object = nullptr;
+};
+
+// Pinhole projection shared by everything that generates or reprojects primary rays
+struct Viewport {
+  Viewport(const Camera& camera, int width, int height);
+
+  glm::vec3 rayDirection(int x, int y) const;
+  // Continuous pixel coordinates of a world point; false when it is behind the camera
+  bool project(const glm::vec3& point, glm::vec2& pixel) const;
+
+  glm::vec3 origin;
+  glm::vec3 forward;
+  glm::vec3 right;
+  glm::vec3 up;
+  int width;
+  int height;
+  float aspectRatio;
+  float tanHalfFov;
+  RayCone cone;
+};
+
+void setUp();
+// Decodes every texture and rewrites the asset bundle setUp() maps
+void buildAssets();
+
+float castShadow(const glm::vec3& point, const glm::vec3& lightDir, const Object* hitObject);
+float castShadow(const std::vector<Object*>& scene, const glm::vec3& point, const glm::vec3& lightDir, const Object* hitObject);
+Color sampleSkybox(const glm::vec3& direction);
+
+Hit traceClosest(const std::vector<Object*>& scene, const glm::vec3& rayOrigin, const glm::vec3& rayDirection);
+// Lights a hit seen along rayDirection, spawning shadow and secondary rays
+// path names the ray for Russian roulette, see pixelPath()
+Color shade(const Hit& hit, const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion = 0, const float weight = 1.0f, const RayCone& cone = RayCone(), uint32_t path = 0);
+// Same, with the hit's shadow factor already known
+Color shade(const Hit& hit, float shadow, const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion, const float weight, const RayCone& cone, uint32_t path);
+// Shadow factor at a hit: the baked lightmap value when there is one,
+// otherwise a traced shadow ray. It does not depend on the view.
+float shadowAt(const Hit& hit);
+Color castRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion = 0, const float weight = 1.0f, const RayCone& cone = RayCone(), uint32_t path = 0);
+
+// Objects whose bounds reach into the frustum of the w x h pixel block at
+// (x0, y0). Every object a primary ray through that block can hit is kept.
+std::vector<Object*> frustumCull(const Viewport& view, const std::vector<Object*>& scene, int x0, int y0, int w, int h);
+// Primary rays only need the objects left after frustumCull
+Color castPrimaryRay(const std::vector<Object*>& visible, const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const RayCone& cone, uint32_t path);
+
+// Traces the w x h block of pixels starting at (x0, y0) of a width x height
+// image seen from camera, writing them row by row into out.
+void renderTile(const Camera& camera, int width, int height, int x0, int y0, int w, int h, Color* out);
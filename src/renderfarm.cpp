@@ -0,0 +1,332 @@
+#include "renderfarm.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+#include <print.h>
+
+#include "net.h"
+#include "ppm.h"
+#include "raytracer.h"
+#include "threadpool.h"
+
+namespace {
+
+// Everything besides the camera that changes what a ray returns. Workers
+// started on their own take these from each job, so every tile is traced
+// with the coordinator's flags.
+struct RenderSettings {
+  float cullWeight;
+  float rouletteWeight;
+  float deepWeight;
+  int32_t textureFilter;
+  int32_t shadowCache;  // lightmap texels per unit, 0 traces every shadow ray
+};
+
+// Wire format: the coordinator sends a TileJob, the worker answers with a
+// TileHeader followed by w * h packed RGB triplets.
+struct TileJob {
+  uint32_t id;
+  uint32_t frame;
+  int32_t x0, y0, w, h;
+  int32_t width, height;
+  float position[3];
+  float target[3];
+  float up[3];
+  RenderSettings settings;
+};
+
+struct TileHeader {
+  uint32_t id;
+  uint32_t bytes;
+};
+
+struct Worker {
+  explicit Worker(int fd) : fd(fd) {}
+
+  int fd;
+  std::vector<TileJob> inFlight;
+  std::vector<Uint8> received;  // bytes of the tile still arriving
+  int tilesDone = 0;
+};
+
+struct Frame {
+  std::vector<Color> pixels;
+  int tilesLeft = 0;
+};
+
+// Tiles a worker may hold at once, so it never idles waiting for the next job
+const size_t TILES_IN_FLIGHT = 2;
+
+std::string frameName(const std::string& output, int frame, int frames) {
+  if (frames == 1) {
+    return output;
+  }
+  char number[16];
+  std::snprintf(number, sizeof(number), "_%04d", frame);
+  size_t dot = output.rfind('.');
+  if (dot == std::string::npos) {
+    return output + number;
+  }
+  return output.substr(0, dot) + number + output.substr(dot);
+}
+
+RenderSettings currentSettings() {
+  return {rayPruning.cullWeight, rayPruning.rouletteWeight, rayPruning.deepWeight,
+          static_cast<int32_t>(textureFilter), useShadowCache ? shadowCache.texelsPerUnit : 0};
+}
+
+void applySettings(const RenderSettings& settings) {
+  rayPruning.cullWeight = settings.cullWeight;
+  rayPruning.rouletteWeight = settings.rouletteWeight;
+  rayPruning.deepWeight = settings.deepWeight;
+  textureFilter = static_cast<TextureFilter>(std::clamp<int32_t>(settings.textureFilter, 0, static_cast<int32_t>(TextureFilter::Trilinear)));
+
+  bool cached = settings.shadowCache > 0;
+  if (cached && (!useShadowCache || shadowCache.texelsPerUnit != settings.shadowCache)) {
+    shadowCache.texelsPerUnit = settings.shadowCache;
+    ThreadPool pool;
+    shadowCache.bake(objects, light.position, pool);
+  }
+  useShadowCache = cached;
+}
+
+pid_t spawnWorker(int listenFd, const std::string& address, int dieAfter) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(listenFd);
+    _exit(runWorker(address, dieAfter));
+  }
+  return pid;
+}
+
+}
+
+int runWorker(const std::string& address, int dieAfter) {
+  // The coordinator may still be binding its socket when we start
+  int fd = -1;
+  for (int attempt = 0; attempt < 50 && fd < 0; attempt++) {
+    fd = connectTo(address);
+    if (fd < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+  if (fd < 0) {
+    print("Worker could not connect to", address);
+    return 1;
+  }
+
+  TileJob job;
+  std::vector<Color> tile;
+  std::vector<Uint8> rgb;
+  int tilesDone = 0;
+  while (readAll(fd, &job, sizeof(job))) {
+    if (dieAfter >= 0 && tilesDone == dieAfter) {
+      _exit(1);
+    }
+    applySettings(job.settings);
+
+    Camera camera(glm::vec3(job.position[0], job.position[1], job.position[2]),
+                  glm::vec3(job.target[0], job.target[1], job.target[2]),
+                  glm::vec3(job.up[0], job.up[1], job.up[2]),
+                  0.0f);
+
+    tile.resize(job.w * job.h);
+    rgb.resize(tile.size() * 3);
+    renderTile(camera, job.width, job.height, job.x0, job.y0, job.w, job.h, tile.data());
+    packRGB(tile.data(), tile.size(), rgb.data());
+
+    TileHeader header{job.id, static_cast<uint32_t>(rgb.size())};
+    if (!writeAll(fd, &header, sizeof(header)) || !writeAll(fd, rgb.data(), rgb.size())) {
+      break;
+    }
+    tilesDone++;
+  }
+
+  close(fd);
+  return 0;
+}
+
+int runCoordinator(const FarmOptions& options, Camera camera) {
+  signal(SIGPIPE, SIG_IGN);
+
+  int listenFd = listenOn(options.address);
+  if (listenFd < 0) {
+    print("Unable to listen on", options.address);
+    return 1;
+  }
+
+  // Queue every tile of every frame up front; jobs are tiny compared to pixels
+  std::deque<TileJob> pending;
+  std::map<uint32_t, Frame> frames;
+  uint32_t nextId = 0;
+  RenderSettings settings = currentSettings();
+  for (int f = 0; f < options.frames; f++) {
+    int tiles = 0;
+    for (int y = 0; y < options.height; y += options.tileSize) {
+      for (int x = 0; x < options.width; x += options.tileSize) {
+        TileJob job{nextId++, static_cast<uint32_t>(f), x, y,
+                    std::min(options.tileSize, options.width - x),
+                    std::min(options.tileSize, options.height - y),
+                    options.width, options.height,
+                    {camera.position.x, camera.position.y, camera.position.z},
+                    {camera.target.x, camera.target.y, camera.target.z},
+                    {camera.up.x, camera.up.y, camera.up.z},
+                    settings};
+        pending.push_back(job);
+        tiles++;
+      }
+    }
+    frames[f].tilesLeft = tiles;
+    camera.rotate(options.orbitStep, 0.0f);
+  }
+  size_t tilesLeft = pending.size();
+
+  std::vector<pid_t> children;
+  for (int i = 0; i < options.workers; i++) {
+    children.push_back(spawnWorker(listenFd, options.address, i == 0 ? options.dieAfter : -1));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Worker> workers;
+  std::vector<int> finishedTileCounts;
+  int redispatched = 0;
+
+  auto dropWorker = [&](size_t index) {
+    Worker& worker = workers[index];
+    print("Worker lost with", worker.inFlight.size(), "tiles in flight, re-dispatching");
+    for (auto it = worker.inFlight.rbegin(); it != worker.inFlight.rend(); ++it) {
+      pending.push_front(*it);
+    }
+    redispatched += worker.inFlight.size();
+    finishedTileCounts.push_back(worker.tilesDone);
+    close(worker.fd);
+    workers.erase(workers.begin() + index);
+  };
+
+  while (tilesLeft > 0) {
+    // Keep every worker busy, fastest ones naturally come back for more
+    for (size_t i = 0; i < workers.size(); i++) {
+      Worker& worker = workers[i];
+      while (worker.inFlight.size() < TILES_IN_FLIGHT && !pending.empty()) {
+        TileJob job = pending.front();
+        if (!writeAll(worker.fd, &job, sizeof(job))) {
+          break;
+        }
+        pending.pop_front();
+        worker.inFlight.push_back(job);
+      }
+    }
+
+    std::vector<pollfd> fds;
+    fds.push_back({listenFd, POLLIN, 0});
+    for (const Worker& worker : workers) {
+      fds.push_back({worker.fd, POLLIN, 0});
+    }
+    poll(fds.data(), fds.size(), 500);
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd >= 0) {
+        workers.emplace_back(fd);
+      }
+    }
+
+    // Walk backwards so dropping a worker does not disturb the remaining indices
+    for (size_t i = fds.size() - 1; i >= 1; i--) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+        continue;
+      }
+
+      // Take what has arrived and keep the rest for the next round, so a
+      // slow worker never holds up the others
+      Worker& worker = workers[i - 1];
+      Uint8 buffer[65536];
+      ssize_t bytes = read(worker.fd, buffer, sizeof(buffer));
+      if (bytes <= 0) {
+        dropWorker(i - 1);
+        continue;
+      }
+      worker.received.insert(worker.received.end(), buffer, buffer + bytes);
+
+      bool ok = true;
+      while (ok && worker.received.size() >= sizeof(TileHeader)) {
+        TileHeader header;
+        std::memcpy(&header, worker.received.data(), sizeof(header));
+
+        // Check the header against the job before waiting for its payload
+        auto job = worker.inFlight.begin();
+        while (job != worker.inFlight.end() && job->id != header.id) {
+          ++job;
+        }
+        ok = job != worker.inFlight.end() && header.bytes == static_cast<uint32_t>(job->w * job->h * 3);
+        if (!ok || worker.received.size() < sizeof(header) + header.bytes) {
+          break;
+        }
+
+        const Uint8* rgb = worker.received.data() + sizeof(header);
+        Frame& frame = frames[job->frame];
+        frame.pixels.resize(options.width * options.height);
+        for (int y = 0; y < job->h; y++) {
+          for (int x = 0; x < job->w; x++) {
+            const Uint8* p = &rgb[(y * job->w + x) * 3];
+            frame.pixels[(job->y0 + y) * options.width + job->x0 + x] = Color(p[0], p[1], p[2]);
+          }
+        }
+
+        if (--frame.tilesLeft == 0) {
+          std::string path = frameName(options.output, job->frame, options.frames);
+          if (!writePPM(path, options.width, options.height, frame.pixels.data())) {
+            print("Error writing", path);
+          }
+          frames.erase(job->frame);
+        }
+
+        worker.received.erase(worker.received.begin(), worker.received.begin() + sizeof(header) + header.bytes);
+        worker.inFlight.erase(job);
+        worker.tilesDone++;
+        tilesLeft--;
+      }
+      if (!ok) {
+        dropWorker(i - 1);
+      }
+    }
+
+    // Reap crashed children and replace them if nobody is left to do the work
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      children.erase(std::remove(children.begin(), children.end(), pid), children.end());
+    }
+    if (children.empty() && workers.empty() && tilesLeft > 0 && options.workers > 0) {
+      print("No workers left, spawning a replacement");
+      children.push_back(spawnWorker(listenFd, options.address, -1));
+    }
+  }
+
+  for (Worker& worker : workers) {
+    finishedTileCounts.push_back(worker.tilesDone);
+    close(worker.fd);
+  }
+  closeListener(listenFd, options.address);
+  for (pid_t child : children) {
+    waitpid(child, nullptr, 0);
+  }
+
+  float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  print("Rendered", options.frames, "frame(s) in", seconds, "s, re-dispatched tiles:", redispatched);
+  for (size_t i = 0; i < finishedTileCounts.size(); i++) {
+    print("  worker", i, "tiles:", finishedTileCounts[i]);
+  }
+  return 0;
+}
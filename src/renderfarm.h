@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include "camera.h"
+
+// A coordinator splits frames into tiles and hands them to worker processes
+// over a Unix socket (a path) or TCP loopback (host:port). Workers run the
+// same scene, trace the tiles with renderTile and send the pixels back.
+struct FarmOptions {
+  std::string address = "/tmp/raytracer-farm.sock";
+  std::string output = "render.ppm";
+  int workers = 4;       // local worker processes forked by the coordinator
+  int width = 500;
+  int height = 300;
+  int tileSize = 32;
+  int frames = 1;
+  float orbitStep = 0.0f; // Camera::rotate step applied between frames
+  int dieAfter = -1;      // make the first local worker crash after this many tiles
+};
+
+int runCoordinator(const FarmOptions& options, Camera camera);
+
+// Connects to a coordinator and renders tiles until it hangs up. A worker
+// with dieAfter >= 0 exits abruptly after that many tiles, to test recovery.
+int runWorker(const std::string& address, int dieAfter = -1);
@@ -0,0 +1,473 @@
+#include "renderservice.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <print.h>
+
+#include "net.h"
+#include "ppm.h"
+#include "raytracer.h"
+#include "threadpool.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Wire format: a client sends RenderRequests, the service answers each with
+// a RenderReply followed by `bytes` of binary PPM. Replies come back in the
+// order renders finish, matched by id.
+struct RenderRequest {
+  uint32_t id;
+  int32_t width, height;
+  int32_t quality;  // trace every 2^quality-th pixel in each direction
+  float position[3];
+  float target[3];
+  float up[3];
+};
+
+enum : int32_t { RENDER_OK = 0, RENDER_BUSY = 1, RENDER_INVALID = 2 };
+
+struct RenderReply {
+  uint32_t id;
+  int32_t status;
+  uint32_t bytes;
+  float queueMs;   // admitted until the first tile started
+  float renderMs;  // first tile started until the image was encoded
+};
+
+const int MAX_SIDE = 16384;
+const int MAX_QUALITY = 4;
+// Tiles handed to the pool per thread; the rest wait here, so a request
+// arriving later still gets its turn after a few tiles instead of the backlog
+const int TILES_PER_THREAD = 2;
+
+// Everyone waiting for the same image
+struct Requester {
+  int client;
+  uint32_t id;
+  Clock::time_point admitted;
+};
+
+struct Client {
+  int fd;
+  std::vector<char> received;  // bytes of a request still arriving
+  std::vector<char> unsent;    // replies the socket has not taken yet
+};
+
+// Sends as much of the client's unsent replies as the socket takes without
+// blocking; false once the connection is gone
+bool flush(Client& client) {
+  size_t sent = 0;
+  while (sent < client.unsent.size()) {
+    ssize_t n = send(client.fd, client.unsent.data() + sent, client.unsent.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  client.unsent.erase(client.unsent.begin(), client.unsent.begin() + sent);
+  return true;
+}
+
+struct Job {
+  RenderRequest request;
+  std::vector<Requester> requesters;
+  int step;
+  int width, height;  // pixels traced across and down, every step-th one
+  int nextRow = 0;     // first row not yet handed to the pool
+  std::vector<Color> pixels;
+  std::vector<Uint8> image;
+  std::atomic<int> tilesLeft{0};
+  std::once_flag started;
+  Clock::time_point startedAt, finishedAt;
+};
+
+float milliseconds(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<float, std::milli>(to - from).count();
+}
+
+// Identical requests differ only in id
+std::string renderKey(const RenderRequest& request) {
+  const char* bytes = reinterpret_cast<const char*>(&request);
+  return std::string(bytes + sizeof(request.id), sizeof(request) - sizeof(request.id));
+}
+
+// Traces rows [y0, y0 + rows) of the job. The view is the one of the full
+// request and only every step-th pixel centre is traced, so a lower quality
+// keeps the framing; each ray stands for step pixels when picking mip levels.
+void traceRows(Job& job, int y0, int rows) {
+  const RenderRequest& r = job.request;
+  Camera camera(glm::vec3(r.position[0], r.position[1], r.position[2]),
+                glm::vec3(r.target[0], r.target[1], r.target[2]),
+                glm::vec3(r.up[0], r.up[1], r.up[2]),
+                0.0f);
+  Viewport view(camera, r.width, r.height);
+  RayCone cone{view.cone.width, view.cone.spread * job.step};
+  int top = y0 * job.step;
+  std::vector<Object*> visible = frustumCull(view, objects, 0, top, r.width, std::min(rows * job.step, r.height - top));
+
+  for (int y = y0; y < y0 + rows; y++) {
+    for (int x = 0; x < job.width; x++) {
+      int px = x * job.step;
+      int py = y * job.step;
+      job.pixels[static_cast<size_t>(y) * job.width + x] =
+          castPrimaryRay(visible, view.origin, view.rayDirection(px, py), cone, pixelPath(px, py));
+    }
+  }
+}
+
+// Binary PPM at the requested size, repeating each traced pixel step times
+void encode(Job& job) {
+  int width = job.request.width;
+  int height = job.request.height;
+  char header[32];
+  int headerBytes = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+  job.image.resize(headerBytes + static_cast<size_t>(width) * height * 3);
+  std::memcpy(job.image.data(), header, headerBytes);
+
+  Uint8* out = job.image.data() + headerBytes;
+  std::vector<Uint8> row(static_cast<size_t>(job.width) * 3);
+  for (int y = 0; y < height; y++) {
+    packRGB(job.pixels.data() + static_cast<size_t>(y / job.step) * job.width, job.width, row.data());
+    for (int x = 0; x < width; x++, out += 3) {
+      std::memcpy(out, &row[(x / job.step) * 3], 3);
+    }
+  }
+}
+
+std::atomic<bool> stopRequested{false};
+
+void requestStop(int) {
+  stopRequested = true;
+}
+
+}
+
+int runService(const ServiceOptions& options) {
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+
+  int listenFd = listenOn(options.address);
+  if (listenFd < 0) {
+    print("Unable to listen on", options.address);
+    return 1;
+  }
+
+  // Pool tasks wake the poll loop through this pipe after every tile
+  int wake[2];
+  if (pipe(wake) != 0) {
+    closeListener(listenFd, options.address);
+    print("Unable to create the wake pipe");
+    return 1;
+  }
+
+  ThreadPool pool(options.threads > 0 ? options.threads : std::thread::hardware_concurrency());
+  std::mutex finishedMutex;
+  std::vector<Job*> finished;
+  std::atomic<int> tilesInPool{0};
+  std::deque<Job*> ready;  // jobs with rows left to hand out, taken in turn
+
+  std::map<int, Client> clients;
+  int nextClient = 0;
+  std::map<Job*, std::unique_ptr<Job>> jobs;
+  std::map<std::string, Job*> rendering;  // in-flight jobs by renderKey
+  long queuedPixels = 0;
+  int queuedRequests = 0;
+
+  int answered = 0;
+  int busy = 0;
+  int invalid = 0;
+  int shared = 0;
+  std::vector<float> latencies;
+  size_t reported = 0;
+  auto start = Clock::now();
+
+  auto report = [&]() {
+    std::vector<float> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](float p) {
+      return sorted.empty() ? 0.0f : sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    };
+    float seconds = std::chrono::duration<float>(Clock::now() - start).count();
+    print("service:", latencies.size(), "rendered,", shared, "shared a render,", busy, "busy,", invalid, "invalid;",
+          "latency p50", percentile(0.5f), "ms p95", percentile(0.95f), "ms max", percentile(1.0f), "ms;",
+          latencies.size() / std::max(seconds, 1e-3f), "requests/s");
+    reported = latencies.size();
+  };
+
+  auto dropClient = [&](int id) {
+    auto it = clients.find(id);
+    if (it != clients.end()) {
+      close(it->second.fd);
+      clients.erase(it);
+    }
+  };
+
+  // Queues the reply behind any the client has not read yet and sends what
+  // the socket takes now; the rest goes out as poll reports room for it
+  auto reply = [&](int client, const RenderReply& header, const std::vector<Uint8>* image) {
+    auto it = clients.find(client);
+    answered++;
+    if (it == clients.end()) {
+      return;
+    }
+    std::vector<char>& unsent = it->second.unsent;
+    const char* bytes = reinterpret_cast<const char*>(&header);
+    unsent.insert(unsent.end(), bytes, bytes + sizeof(header));
+    if (image) {
+      unsent.insert(unsent.end(), image->begin(), image->end());
+    }
+    if (!flush(it->second)) {
+      dropClient(client);
+    } else if (static_cast<long>(unsent.size()) > options.maxReplyBacklog) {
+      print("Dropping a client with", unsent.size(), "bytes of replies unread");
+      dropClient(client);
+    }
+  };
+
+  print("Serving renders on", options.address, "with", pool.size(), "threads");
+  // A test run with maxRequests still delivers every reply it queued
+  auto replying = [&]() {
+    return std::any_of(clients.begin(), clients.end(), [](const auto& client) { return !client.second.unsent.empty(); });
+  };
+
+  while (!stopRequested && (options.maxRequests < 0 || answered < options.maxRequests || !jobs.empty() || replying())) {
+    std::vector<pollfd> fds;
+    std::vector<int> polled;
+    fds.push_back({listenFd, POLLIN, 0});
+    fds.push_back({wake[0], POLLIN, 0});
+    for (const auto& [id, client] : clients) {
+      short events = client.unsent.empty() ? POLLIN : POLLIN | POLLOUT;
+      fds.push_back({client.fd, events, 0});
+      polled.push_back(id);
+    }
+    poll(fds.data(), fds.size(), 500);
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        clients[nextClient++] = Client{fd, {}, {}};
+      }
+    }
+
+    // Requests are taken as far as their bytes have arrived, so a client
+    // sending slowly never holds up the loop
+    std::vector<std::pair<int, RenderRequest>> received;
+    for (size_t i = 2; i < fds.size(); i++) {
+      int id = polled[i - 2];
+      if ((fds[i].revents & POLLOUT) && !flush(clients.at(id))) {
+        dropClient(id);
+        continue;
+      }
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+        continue;
+      }
+      Client& client = clients.at(id);
+      char buffer[4096];
+      ssize_t bytes = read(client.fd, buffer, sizeof(buffer));
+      if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        continue;
+      }
+      if (bytes <= 0) {
+        dropClient(id);
+        continue;
+      }
+      client.received.insert(client.received.end(), buffer, buffer + bytes);
+      size_t used = 0;
+      while (client.received.size() - used >= sizeof(RenderRequest)) {
+        RenderRequest request;
+        std::memcpy(&request, client.received.data() + used, sizeof(request));
+        received.push_back({id, request});
+        used += sizeof(request);
+      }
+      client.received.erase(client.received.begin(), client.received.begin() + used);
+    }
+
+    for (const auto& [client, request] : received) {
+      RenderReply header{request.id, RENDER_OK, 0, 0.0f, 0.0f};
+      long pixels = static_cast<long>(request.width) * request.height;
+      if (request.width < 1 || request.height < 1 || request.width > MAX_SIDE || request.height > MAX_SIDE ||
+          request.quality < 0 || request.quality > MAX_QUALITY || pixels > options.maxQueuedPixels) {
+        header.status = RENDER_INVALID;
+        invalid++;
+        reply(client, header, nullptr);
+        continue;
+      }
+
+      // The scene never changes, so a request for an image already being
+      // rendered just waits for that one
+      std::string key = renderKey(request);
+      auto same = rendering.find(key);
+      if (same != rendering.end()) {
+        same->second->requesters.push_back({client, request.id, Clock::now()});
+        queuedRequests++;
+        shared++;
+        continue;
+      }
+
+      // Admission control: refuse rather than let latency grow without bound
+      if (queuedRequests >= options.maxQueuedRequests || queuedPixels + pixels > options.maxQueuedPixels) {
+        header.status = RENDER_BUSY;
+        busy++;
+        reply(client, header, nullptr);
+        continue;
+      }
+
+      auto job = std::make_unique<Job>();
+      job->request = request;
+      job->requesters.push_back({client, request.id, Clock::now()});
+      job->step = 1 << request.quality;
+      job->width = (request.width + job->step - 1) / job->step;
+      job->height = (request.height + job->step - 1) / job->step;
+      job->pixels.resize(static_cast<size_t>(job->width) * job->height);
+      job->tilesLeft = (job->height + options.tileRows - 1) / options.tileRows;
+      queuedPixels += pixels;
+      queuedRequests++;
+      rendering[key] = job.get();
+      ready.push_back(job.get());
+      jobs[job.get()] = std::move(job);
+    }
+
+    // Every request readable this round joined the batch above; top the pool
+    // up taking a tile from each job in turn, so small jobs finish early
+    while (!ready.empty() && tilesInPool < static_cast<int>(pool.size()) * TILES_PER_THREAD) {
+      Job* job = ready.front();
+      ready.pop_front();
+      int y0 = job->nextRow;
+      int rows = std::min(options.tileRows, job->height - y0);
+      job->nextRow += rows;
+      if (job->nextRow < job->height) {
+        ready.push_back(job);
+      }
+
+      tilesInPool++;
+      pool.submit([job, y0, rows, &finishedMutex, &finished, &tilesInPool, &wake] {
+        std::call_once(job->started, [job] { job->startedAt = Clock::now(); });
+        traceRows(*job, y0, rows);
+        if (--job->tilesLeft == 0) {
+          encode(*job);
+          job->finishedAt = Clock::now();
+          std::lock_guard<std::mutex> lock(finishedMutex);
+          finished.push_back(job);
+        }
+        // Wake the loop before letting go of the task: shutdown closes the
+        // pipe once no task is left
+        char byte = 0;
+        (void)write(wake[1], &byte, 1);
+        tilesInPool--;
+      });
+    }
+
+    if (fds[1].revents & POLLIN) {
+      char drain[256];
+      (void)read(wake[0], drain, sizeof(drain));
+    }
+    std::vector<Job*> done;
+    {
+      std::lock_guard<std::mutex> lock(finishedMutex);
+      done.swap(finished);
+    }
+    for (Job* job : done) {
+      auto now = Clock::now();
+      for (const Requester& requester : job->requesters) {
+        // Requests that joined a running job waited for none of it
+        Clock::time_point started = std::max(requester.admitted, job->startedAt);
+        RenderReply header{requester.id, RENDER_OK, static_cast<uint32_t>(job->image.size()),
+                           milliseconds(requester.admitted, started),
+                           milliseconds(started, job->finishedAt)};
+        reply(requester.client, header, &job->image);
+        latencies.push_back(milliseconds(requester.admitted, now));
+      }
+      queuedPixels -= static_cast<long>(job->request.width) * job->request.height;
+      queuedRequests -= job->requesters.size();
+      rendering.erase(renderKey(job->request));
+      jobs.erase(job);
+    }
+
+    if (latencies.size() >= reported + 100) {
+      report();
+    }
+  }
+
+  // Tiles in the pool still point at their jobs
+  if (!jobs.empty()) {
+    print("Dropping", jobs.size(), "unfinished render(s)");
+  }
+  while (tilesInPool > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  for (const auto& [id, client] : clients) {
+    close(client.fd);
+  }
+  closeListener(listenFd, options.address);
+  close(wake[0]);
+  close(wake[1]);
+  report();
+  return 0;
+}
+
+int requestRender(const std::string& address, const Camera& camera, int width, int height, int quality, const std::string& output) {
+  int fd = connectTo(address);
+  if (fd < 0) {
+    print("Unable to connect to", address);
+    return 1;
+  }
+
+  auto start = Clock::now();
+  RenderRequest request{0, width, height, quality,
+                        {camera.position.x, camera.position.y, camera.position.z},
+                        {camera.target.x, camera.target.y, camera.target.z},
+                        {camera.up.x, camera.up.y, camera.up.z}};
+  RenderReply header;
+  std::vector<Uint8> image;
+  bool ok = writeAll(fd, &request, sizeof(request)) && readAll(fd, &header, sizeof(header));
+  if (ok) {
+    image.resize(header.bytes);
+    ok = readAll(fd, image.data(), image.size());
+  }
+  close(fd);
+  if (!ok) {
+    print("Lost the connection to", address);
+    return 1;
+  }
+  if (header.status != RENDER_OK) {
+    print(header.status == RENDER_BUSY ? "Service busy, try again later" : "Service rejected the request");
+    return header.status == RENDER_BUSY ? 2 : 1;
+  }
+
+  FILE* file = std::fopen(output.c_str(), "wb");
+  bool written = file && std::fwrite(image.data(), 1, image.size(), file) == image.size();
+  if (!file || std::fclose(file) != 0 || !written) {
+    print("Error writing", output);
+    return 1;
+  }
+  print("Wrote", output, "in", milliseconds(start, Clock::now()), "ms: queued", header.queueMs,
+        "ms, rendered", header.renderMs, "ms");
+  return 0;
+}
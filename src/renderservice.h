@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include "camera.h"
+
+// Long-lived headless renderer: the scene is set up once, then clients
+// connect over a Unix socket (a path) or TCP loopback (host:port) and send
+// render requests, each answered with a PPM image.
+//
+// Requests read in the same poll round form a batch. A request identical to
+// one already being rendered shares its image, and the pool is fed a tile
+// from each job in turn, so a small request is not stuck behind a large one.
+// Admission control answers Busy instead of queueing past the limits.
+// Replies are queued per client and sent as the socket takes them, so a
+// client that stops reading only ever holds up itself; once its unsent
+// replies pass maxReplyBacklog it is disconnected.
+struct ServiceOptions {
+  std::string address = "/tmp/raytracer-service.sock";
+  int threads = 0;                 // 0 uses every core
+  long maxQueuedPixels = 8000000;  // admitted but unfinished pixels
+  int maxQueuedRequests = 64;
+  int tileRows = 16;
+  long maxReplyBacklog = 64 << 20; // unsent reply bytes per client
+  int maxRequests = -1;            // stop after answering this many, for tests
+};
+
+int runService(const ServiceOptions& options);
+
+// Sends one request to a running service and writes the returned image to
+// output. quality n traces every 2^n-th pixel in each direction.
+int requestRender(const std::string& address, const Camera& camera, int width, int height, int quality, const std::string& output);
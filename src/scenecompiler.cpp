@@ -0,0 +1,259 @@
+#include "scenecompiler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <memory>
+#include "cube.h"
+#include "voxelquad.h"
+
+namespace {
+
+bool sameMaterial(const Material& a, const Material& b) {
+  return a.texture == b.texture && a.albedo == b.albedo && a.specularAlbedo == b.specularAlbedo &&
+         a.specularCoefficient == b.specularCoefficient && a.reflectivity == b.reflectivity &&
+         a.transparency == b.transparency && a.refractionIndex == b.refractionIndex &&
+         a.maxRecursion == b.maxRecursion;
+}
+
+struct Voxel {
+  const Cube* cube;
+  int order;
+  std::array<int, 3> cell;
+  int material;
+  int hiddenFaces = 0;
+};
+
+// One exposed face waiting to be merged
+struct FaceCell {
+  int b;
+  int c;
+  size_t voxel;
+  int kind;
+};
+
+bool inside(const glm::vec3& point, const Object* object) {
+  glm::vec3 min, max;
+  object->bounds(min, max);
+  return point.x >= min.x && point.x <= max.x &&
+         point.y >= min.y && point.y <= max.y &&
+         point.z >= min.z && point.z <= max.z;
+}
+
+}
+
+std::vector<Object*> compileScene(const std::vector<Object*>& scene) {
+  // Opaque cubes of one size sitting on a common grid are the ones that can
+  // hide each other's faces; everything else passes through untouched
+  float side = 0.0f;
+  std::vector<Voxel> voxels;
+  std::vector<Material> materials;
+  std::map<std::array<int, 3>, size_t> grid;
+  std::vector<std::pair<int, Object*>> compiled;
+  std::vector<const Object*> others;
+
+  for (int order = 0; order < static_cast<int>(scene.size()); order++) {
+    const Cube* cube = dynamic_cast<const Cube*>(scene[order]);
+    if (cube && cube->material.transparency == 0.0f) {
+      if (side == 0.0f) {
+        side = cube->getSide();
+      }
+      const glm::vec3& center = cube->getCenter();
+      std::array<int, 3> cell;
+      bool onGrid = cube->getSide() == side;
+      for (int axis = 0; axis < 3; axis++) {
+        cell[axis] = static_cast<int>(std::round(center[axis] / side));
+        onGrid = onGrid && center[axis] == cell[axis] * side;
+      }
+
+      if (onGrid && !grid.count(cell)) {
+        int material = 0;
+        while (material < static_cast<int>(materials.size()) && !sameMaterial(materials[material], cube->material)) {
+          material++;
+        }
+        if (material == static_cast<int>(materials.size())) {
+          materials.push_back(cube->material);
+        }
+        grid[cell] = voxels.size();
+        voxels.push_back({cube, order, cell, material});
+        continue;
+      }
+    }
+    compiled.push_back({order, scene[order]});
+    others.push_back(scene[order]);
+  }
+
+  auto opensOntoOther = [&](const Voxel& voxel, int axis, int sign) {
+    glm::vec3 outside = voxel.cube->getCenter();
+    outside[axis] += sign * (side / 2.0f + 0.01f);
+    for (const Object* other : others) {
+      if (inside(outside, other)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Rays refracted out of water start inside the blocks around it and must
+  // still meet their inner faces, so blocks touching a kept object stay whole
+  std::vector<bool> whole(voxels.size(), false);
+  for (size_t i = 0; i < voxels.size(); i++) {
+    for (int face = 0; face < 6 && !whole[i]; face++) {
+      whole[i] = opensOntoOther(voxels[i], face / 2, face % 2 ? -1 : 1);
+    }
+  }
+  for (size_t i = 0; i < voxels.size(); i++) {
+    if (whole[i]) {
+      grid.erase(voxels[i].cell);
+      compiled.push_back({voxels[i].order, const_cast<Cube*>(voxels[i].cube)});
+      others.push_back(voxels[i].cube);
+    }
+  }
+
+  // Collect the faces nothing opaque is pressed against, per plane. A face
+  // against a kept object stays a quad of its own, so it keeps its block's
+  // place in the scene order when it ties with that object.
+  int unique = static_cast<int>(materials.size());
+  std::map<std::array<int, 3>, std::vector<FaceCell>> planes;
+  for (size_t i = 0; i < voxels.size(); i++) {
+    Voxel& voxel = voxels[i];
+    if (whole[i]) {
+      continue;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      for (int sign = -1; sign <= 1; sign += 2) {
+        std::array<int, 3> neighbour = voxel.cell;
+        neighbour[axis] += sign;
+        if (grid.count(neighbour)) {
+          voxel.hiddenFaces |= 1 << (axis * 2 + (sign > 0 ? 0 : 1));
+          continue;
+        }
+
+        int kind = opensOntoOther(voxel, axis, sign) ? unique++ : voxel.material;
+
+        int b = (axis + 1) % 3;
+        int c = (axis + 2) % 3;
+        planes[{axis, sign, voxel.cell[axis]}].push_back({voxel.cell[b], voxel.cell[c], i, kind});
+      }
+    }
+  }
+
+  // Greedy merge: grow a rectangle along b as far as the row allows, then
+  // along c while every row below matches
+  for (const auto& [key, cells] : planes) {
+    int axis = key[0];
+    int sign = key[1];
+    int bMin = cells[0].b, bMax = cells[0].b, cMin = cells[0].c, cMax = cells[0].c;
+    for (const FaceCell& cell : cells) {
+      bMin = std::min(bMin, cell.b);
+      bMax = std::max(bMax, cell.b);
+      cMin = std::min(cMin, cell.c);
+      cMax = std::max(cMax, cell.c);
+    }
+    int columns = bMax - bMin + 1;
+    int rows = cMax - cMin + 1;
+    std::vector<const FaceCell*> mask(columns * rows, nullptr);
+    for (const FaceCell& cell : cells) {
+      mask[(cell.c - cMin) * columns + (cell.b - bMin)] = &cell;
+    }
+    auto kindAt = [&](int b, int c) {
+      const FaceCell* cell = mask[(c - cMin) * columns + (b - bMin)];
+      return cell ? cell->kind : -1;
+    };
+
+    auto plane = std::make_shared<VoxelPlane>();
+    plane->axis = axis;
+    plane->side = side;
+
+    for (int c = cMin; c <= cMax; c++) {
+      for (int b = bMin; b <= bMax; b++) {
+        int kind = kindAt(b, c);
+        if (kind < 0) {
+          continue;
+        }
+
+        int w = 1;
+        while (b + w <= bMax && kindAt(b + w, c) == kind) {
+          w++;
+        }
+        int h = 1;
+        bool rowMatches = true;
+        while (c + h <= cMax && rowMatches) {
+          for (int x = b; x < b + w && rowMatches; x++) {
+            rowMatches = kindAt(x, c + h) == kind;
+          }
+          if (rowMatches) {
+            h++;
+          }
+        }
+
+        // The plane is written exactly as the cubes write it
+        const Voxel& first = voxels[mask[(c - cMin) * columns + (b - bMin)]->voxel];
+        float half = side / 2.0f;
+        float offset = first.cube->getCenter()[axis];
+        glm::vec4 equation(0.0f, 0.0f, 0.0f, sign > 0 ? offset + half : -(offset - half));
+        equation[axis] = static_cast<float>(sign);
+
+        VoxelQuad* quad = new VoxelQuad(plane, equation, b, c, b + w - 1, c + h - 1, first.cube->material);
+        int order = first.order;
+        for (int y = c; y < c + h; y++) {
+          for (int x = b; x < b + w; x++) {
+            const FaceCell*& cell = mask[(y - cMin) * columns + (x - bMin)];
+            const Voxel& voxel = voxels[cell->voxel];
+            plane->cells[VoxelPlane::key(x, y)] = {voxel.cube, voxel.order, quad, voxel.hiddenFaces};
+            order = std::min(order, voxel.order);
+            cell = nullptr;
+          }
+        }
+        compiled.push_back({order, quad});
+      }
+    }
+  }
+
+  // Keep the scene order so equal distances resolve as they used to
+  std::stable_sort(compiled.begin(), compiled.end(), [](const auto& a, const auto& b) {
+    return a.first < b.first;
+  });
+  std::vector<Object*> result;
+  for (const auto& entry : compiled) {
+    result.push_back(entry.second);
+  }
+  return result;
+}
+
+long verifyCompiledScene(const std::vector<Object*>& scene, const std::vector<Object*>& compiled,
+                         const Viewport& view, const glm::vec3& lightPosition) {
+  auto differs = [&](const glm::vec3& origin, const glm::vec3& direction, Hit& hit) {
+    hit = traceClosest(scene, origin, direction);
+    Hit other = traceClosest(compiled, origin, direction);
+    const Intersect& a = hit.intersect;
+    const Intersect& b = other.intersect;
+    if (a.isIntersecting != b.isIntersecting) {
+      return true;
+    }
+    return a.isIntersecting &&
+           (a.dist != b.dist || a.point != b.point || a.normal != b.normal || a.uv != b.uv ||
+            !sameMaterial(hit.object->material, other.object->material));
+  };
+
+  long mismatches = 0;
+  for (int y = 0; y < view.height; y++) {
+    for (int x = 0; x < view.width; x++) {
+      glm::vec3 direction = view.rayDirection(x, y);
+      Hit hit;
+      mismatches += differs(view.origin, direction, hit);
+      if (!hit.intersect.isIntersecting) {
+        continue;
+      }
+
+      // The rays shading spawns start on the surface, where merged faces meet
+      const Intersect& i = hit.intersect;
+      glm::vec3 origin = i.point + i.normal * BIAS;
+      Hit bounce;
+      mismatches += differs(origin, glm::reflect(direction, i.normal), bounce);
+      mismatches += differs(origin, glm::normalize(lightPosition - i.point), bounce);
+    }
+  }
+  return mismatches;
+}
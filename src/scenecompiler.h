@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+#include "object.h"
+#include "raytracer.h"
+
+// Turns the voxel part of a scene into the faces that can actually be seen.
+// Faces of opaque cubes pressed against another opaque cube are dropped and
+// the rest are greedily merged into the largest rectangles of one material,
+// so a ray tests a few planes instead of six per cube. Transparent cubes,
+// the blocks touching them, cubes off the grid and other objects are kept as
+// they are. Hits are the ones the original cubes give, and ties still go to
+// the earliest object.
+std::vector<Object*> compileScene(const std::vector<Object*>& scene);
+
+// Rays whose traceClosest hit in compiled differs from the one in scene: the
+// primary ray of every pixel of view, and from each primary hit the mirror
+// ray and the ray towards lightPosition
+long verifyCompiledScene(const std::vector<Object*>& scene, const std::vector<Object*>& compiled,
+                         const Viewport& view, const glm::vec3& lightPosition);
@@ -0,0 +1,216 @@
+#include "shadowcache.h"
+
+#include <algorithm>
+#include <cmath>
+#include "raytracer.h"
+
+namespace {
+
+bool overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+  return minA.x <= maxB.x && maxA.x >= minB.x &&
+         minA.y <= maxB.y && maxA.y >= minB.y &&
+         minA.z <= maxB.z && maxA.z >= minB.z;
+}
+
+}
+
+void ShadowCache::bake(const std::vector<Object*>& scene, const glm::vec3& lightPosition, ThreadPool& pool) {
+  entries.clear();
+  index.clear();
+  dirtyFaces = 0;
+  light = lightPosition;
+  update(scene, pool);
+}
+
+void ShadowCache::update(const std::vector<Object*>& scene, ThreadPool& pool) {
+  // Forget objects that left the scene and pick up the ones that joined
+  std::unordered_map<const Object*, bool> present;
+  for (const Object* object : scene) {
+    present[object] = true;
+  }
+  std::vector<std::pair<glm::vec3, glm::vec3>> changed;
+  entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& entry) {
+    if (present.count(entry.object)) {
+      return false;
+    }
+    changed.push_back({entry.min, entry.max});
+    return true;
+  }), entries.end());
+  index.clear();
+  for (size_t i = 0; i < entries.size(); i++) {
+    index[entries[i].object] = i;
+  }
+
+  for (const Object* object : scene) {
+    // Curved objects get no lightmaps but are tracked, so their comings and
+    // goings still invalidate the faces around them
+    if (index.count(object)) {
+      continue;
+    }
+    std::vector<Face> faces = object->faces();
+    Entry entry{object, {}, glm::vec3(0.0f), glm::vec3(0.0f)};
+    object->bounds(entry.min, entry.max);
+    changed.push_back({entry.min, entry.max});
+    for (const Face& face : faces) {
+      Lightmap map;
+      map.face = face;
+      map.width = std::max(1, static_cast<int>(std::ceil(glm::length(face.u) * texelsPerUnit)));
+      map.height = std::max(1, static_cast<int>(std::ceil(glm::length(face.v) * texelsPerUnit)));
+      entry.maps.push_back(map);
+    }
+    index[object] = entries.size();
+    entries.push_back(entry);
+  }
+
+  // Faces the joining or leaving objects may now shadow, or no longer do
+  for (const auto& [min, max] : changed) {
+    invalidateRegion(min, max);
+  }
+
+  std::vector<std::pair<const Object*, Lightmap*>> work;
+  for (Entry& entry : entries) {
+    for (Lightmap& map : entry.maps) {
+      if (map.dirty) {
+        work.push_back({entry.object, &map});
+      }
+    }
+  }
+
+  pool.parallelFor(work.size(), [&](int i) {
+    bakeMap(scene, work[i].first, *work[i].second);
+  });
+  bakedFaces += work.size();
+  dirtyFaces = 0;
+}
+
+void ShadowCache::bakeMap(const std::vector<Object*>& scene, const Object* object, Lightmap& map) {
+  const Face& face = map.face;
+  map.dirty = false;
+
+  // A face buried against another object can never be hit from outside
+  glm::vec3 outside = face.origin + 0.5f * (face.u + face.v) + face.normal * 0.01f;
+  map.exposed = true;
+  for (const Object* other : scene) {
+    glm::vec3 min, max;
+    other->bounds(min, max);
+    if (other != object && overlaps(outside, outside, min, max)) {
+      map.exposed = false;
+      break;
+    }
+  }
+  if (!map.exposed) {
+    map.shadow.clear();
+    return;
+  }
+
+  map.shadow.resize(map.width * map.height);
+  for (int y = 0; y < map.height; y++) {
+    for (int x = 0; x < map.width; x++) {
+      glm::vec3 point = face.origin + face.u * ((x + 0.5f) / map.width) + face.v * ((y + 0.5f) / map.height);
+      glm::vec3 lightDir = glm::normalize(light - point);
+      map.shadow[y * map.width + x] = castShadow(scene, point + face.normal * BIAS, lightDir, object);
+    }
+  }
+}
+
+bool ShadowCache::lookup(const Object* object, const Intersect& hit, float& shadow) const {
+  auto it = index.find(object);
+  if (it == index.end()) {
+    return false;
+  }
+  int faceIndex = object->faceOf(hit);
+  if (faceIndex < 0) {
+    return false;
+  }
+
+  // Hits from inside the object shade with the inward normal, which was not baked
+  const Lightmap& map = entries[it->second].maps[faceIndex];
+  if (map.dirty || !map.exposed || glm::dot(hit.normal, map.face.normal) <= 0) {
+    return false;
+  }
+
+  glm::vec3 d = hit.point - map.face.origin;
+  float s = glm::dot(d, map.face.u) / glm::dot(map.face.u, map.face.u);
+  float t = glm::dot(d, map.face.v) / glm::dot(map.face.v, map.face.v);
+
+  int x = std::clamp(static_cast<int>(s * map.width), 0, map.width - 1);
+  int y = std::clamp(static_cast<int>(t * map.height), 0, map.height - 1);
+  shadow = map.shadow[y * map.width + x];
+  return true;
+}
+
+void ShadowCache::reach(const Lightmap& map, const glm::vec3& lightPosition, glm::vec3& min, glm::vec3& max) const {
+  const Face& face = map.face;
+  glm::vec3 corners[4] = {face.origin, face.origin + face.u, face.origin + face.v, face.origin + face.u + face.v};
+
+  min = max = corners[0];
+  for (const glm::vec3& corner : corners) {
+    glm::vec3 end = corner + glm::normalize(lightPosition - corner) * SHADOW_REACH;
+    min = glm::min(min, glm::min(corner, end));
+    max = glm::max(max, glm::max(corner, end));
+  }
+  // Shadow rays from inside the face fan out slightly beyond the corner rays
+  min = min - glm::vec3(0.1f * SHADOW_REACH);
+  max = max + glm::vec3(0.1f * SHADOW_REACH);
+}
+
+void ShadowCache::markDirty(Lightmap& map) {
+  if (!map.dirty) {
+    map.dirty = true;
+    dirtyFaces++;
+  }
+}
+
+void ShadowCache::invalidateRegion(const glm::vec3& min, const glm::vec3& max) {
+  for (Entry& entry : entries) {
+    for (Lightmap& map : entry.maps) {
+      glm::vec3 reachMin, reachMax;
+      reach(map, light, reachMin, reachMax);
+      if (overlaps(reachMin, reachMax, min, max)) {
+        markDirty(map);
+      }
+    }
+  }
+}
+
+long ShadowCache::differingTexels(const ShadowCache& other) const {
+  long differing = 0;
+  for (const Entry& entry : entries) {
+    auto it = other.index.find(entry.object);
+    for (size_t m = 0; m < entry.maps.size(); m++) {
+      const Lightmap& map = entry.maps[m];
+      const Lightmap* twin = it == other.index.end() ? nullptr : &other.entries[it->second].maps[m];
+      if (!twin || twin->exposed != map.exposed || twin->shadow.size() != map.shadow.size()) {
+        differing += std::max<size_t>(1, map.shadow.size());
+        continue;
+      }
+      for (size_t i = 0; i < map.shadow.size(); i++) {
+        differing += map.shadow[i] != twin->shadow[i];
+      }
+    }
+  }
+  return differing;
+}
+
+void ShadowCache::lightMoved(const std::vector<Object*>& scene, const glm::vec3& newPosition) {
+  // A face keeps its bake if no other object sits where either the old or the
+  // new shadow rays could reach: it was unshadowed and still is
+  for (Entry& entry : entries) {
+    for (Lightmap& map : entry.maps) {
+      glm::vec3 oldMin, oldMax, newMin, newMax;
+      reach(map, light, oldMin, oldMax);
+      reach(map, newPosition, newMin, newMax);
+
+      for (const Object* other : scene) {
+        glm::vec3 min, max;
+        other->bounds(min, max);
+        if (other != entry.object &&
+            (overlaps(oldMin, oldMax, min, max) || overlaps(newMin, newMax, min, max))) {
+          markDirty(map);
+          break;
+        }
+      }
+    }
+  }
+  light = newPosition;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "intersect.h"
+#include "object.h"
+#include "threadpool.h"
+
+// Baked shadow visibility for static geometry. Every exposed face of every
+// faceted object gets a small lightmap holding what castShadow returns at
+// each texel centre, so shading a hit is a lookup instead of a shadow ray.
+// Lookups take the nearest texel: shadows here are hard, so blending texels
+// would only smear the edge further from the traced one. Edges are placed to
+// within half a texel, which is the trade-off texelsPerUnit sets.
+//
+// Scene edits and light moves only mark the faces whose shadow rays could
+// reach the changed region dirty; update() re-bakes just those.
+class ShadowCache {
+public:
+  // Both bake the dirty faces on pool and must not be called from a pool task
+  void bake(const std::vector<Object*>& scene, const glm::vec3& lightPosition, ThreadPool& pool);
+  // Also picks up objects that joined or left scene since the last call and
+  // invalidates the region each of them covers
+  void update(const std::vector<Object*>& scene, ThreadPool& pool);
+
+  // Shadow factor baked for a hit, false if the hit is not covered
+  bool lookup(const Object* object, const Intersect& hit, float& shadow) const;
+
+  // Call after adding, removing or moving geometry inside [min, max]
+  void invalidateRegion(const glm::vec3& min, const glm::vec3& max);
+  void lightMoved(const std::vector<Object*>& scene, const glm::vec3& newPosition);
+
+  bool dirty() const { return dirtyFaces > 0; }
+
+  // Texels whose baked value differs from other's, for checking invalidation
+  // against a bake from scratch
+  long differingTexels(const ShadowCache& other) const;
+
+  // At 8, about 100 pixels of a 500x300 frame land on the other side of a
+  // shadow edge than a traced shadow ray would put them; 32 brings that down
+  // to about 10, and every doubling quadruples the bake work
+  int texelsPerUnit = 8;
+  long bakedFaces = 0;
+
+private:
+  struct Lightmap {
+    Face face;
+    int width = 0;
+    int height = 0;
+    bool exposed = false;
+    bool dirty = true;
+    std::vector<float> shadow;
+  };
+
+  struct Entry {
+    const Object* object;
+    std::vector<Lightmap> maps;
+    glm::vec3 min;  // bounds when it was added, the object may be gone by
+    glm::vec3 max;  // the time it leaves the scene
+  };
+
+  // Box holding every point whose shadow ray from this face could see
+  void reach(const Lightmap& map, const glm::vec3& lightPosition, glm::vec3& min, glm::vec3& max) const;
+  void bakeMap(const std::vector<Object*>& scene, const Object* object, Lightmap& map);
+  void markDirty(Lightmap& map);
+
+  std::vector<Entry> entries;
+  std::unordered_map<const Object*, size_t> index;
+  glm::vec3 light;
+  int dirtyFaces = 0;
+};
@@ -1,38 +1,39 @@
-#include <SDL.h>
-#include <SDL2/SDL_image.h>
 #include <string>
 #include <array>
+#include <stdexcept>
 #include "color.h"
+#include "texture.h"
 
 class Skybox {
 public:
-    Skybox(const std::string& directory);
-    Color loadTexture(const std::string& filename, int x, int y);
+    Skybox() : textures{} {}
+    // Faces in order: right, back, top, bottom, front, left
+    Skybox(const std::array<Texture*, 6>& faces);
     Color sample(float u, float v);
 
+    // Image files of the six faces inside directory, in the order the constructor expects
+    static std::array<std::string, 6> faceFiles(const std::string& directory);
+
 private:
-    std::array<SDL_Surface*, 6> textures; // The six textures for the skybox
+    std::array<Texture*, 6> textures; // The six textures for the skybox
 };
 
-Skybox::Skybox(const std::string& directory) {
-    // Initialize SDL_image
-    int imgFlags = IMG_INIT_PNG;
-    if (!(IMG_Init(imgFlags) & imgFlags)) {
-        throw std::runtime_error("Failed to initialize SDL_image: " + std::string(IMG_GetError()));
-    }
-
-    // Load the six textures for the skybox
-    textures[0] = IMG_Load((directory + "/right.png").c_str());
-    textures[1] = IMG_Load((directory + "/back.png").c_str());
-    textures[2] = IMG_Load((directory + "/top.png").c_str());
-    textures[3] = IMG_Load((directory + "/bottom.png").c_str());
-    textures[4] = IMG_Load((directory + "/front.png").c_str());
-    textures[5] = IMG_Load((directory + "/left.png").c_str());
+std::array<std::string, 6> Skybox::faceFiles(const std::string& directory) {
+    return {
+        directory + "/right.png",
+        directory + "/back.png",
+        directory + "/top.png",
+        directory + "/bottom.png",
+        directory + "/front.png",
+        directory + "/left.png"
+    };
+}
 
+Skybox::Skybox(const std::array<Texture*, 6>& faces) : textures(faces) {
     // Check if textures loaded successfully
     for (auto& texture : textures) {
         if (!texture) {
-            throw std::runtime_error("Failed to load texture: " + std::string(IMG_GetError()));
+            throw std::runtime_error("Failed to load skybox texture");
         }
     }
 }
@@ -72,39 +73,14 @@ Color Skybox::sample(float u, float v) {
     vFace = vFace * 0.5f + 0.5f;
 
     // Convert texture coordinates to pixel coordinates
-    int x = static_cast<int>(uFace * textures[faceIndex]->w);
-    int y = static_cast<int>(vFace * textures[faceIndex]->h);
+    int x = static_cast<int>(uFace * textures[faceIndex]->width());
+    int y = static_cast<int>(vFace * textures[faceIndex]->height());
 
     // Make sure the coordinates are within the texture's bounds
-    if (x < 0 || y < 0 || x >= textures[faceIndex]->w || y >= textures[faceIndex]->h) {
+    if (x < 0 || y < 0 || x >= textures[faceIndex]->width() || y >= textures[faceIndex]->height()) {
         throw std::runtime_error("Texture coordinates out of bounds");
     }
 
     // Get the color of the pixel at the given coordinates
-    int bpp = textures[faceIndex]->format->BytesPerPixel;
-    Uint8 *p = (Uint8 *)textures[faceIndex]->pixels + y * textures[faceIndex]->pitch + x * bpp;
-    Uint32 pixel;
-    switch (bpp) {
-        case 1:
-            pixel = *p;
-            break;
-        case 2:
-            pixel = *(Uint16 *)p;
-            break;
-        case 3:
-            if (SDL_BYTEORDER == SDL_BIG_ENDIAN) {
-                pixel = p[0] << 16 | p[1] << 8 | p[2];
-            } else {
-                pixel = p[0] | p[1] << 8 | p[2] << 16;
-            }
-            break;
-        case 4:
-            pixel = *(Uint32 *)p;
-            break;
-        default:
-            throw std::runtime_error("Unknown format!");
-    }
-    SDL_Color colorTexture;
-    SDL_GetRGB(pixel, textures[faceIndex]->format, &colorTexture.r, &colorTexture.g, &colorTexture.b);
-    return Color(colorTexture.r, colorTexture.g, colorTexture.b);
+    return textures[faceIndex]->at(x, y);
 }
\ No newline at end of file
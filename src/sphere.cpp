@@ -26,3 +26,8 @@ Intersect Sphere::rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayD
   glm::vec3 normal = glm::normalize(point - center);
   return Intersect{true, dist, point, normal};
 }
+
+void Sphere::bounds(glm::vec3& min, glm::vec3& max) const {
+  min = center - glm::vec3(radius);
+  max = center + glm::vec3(radius);
+}
@@ -11,6 +11,8 @@ public:
 
   Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const override;
 
+  void bounds(glm::vec3& min, glm::vec3& max) const override;
+
 private:
   glm::vec3 center;
   float radius;
@@ -0,0 +1,117 @@
+#include "temporalcache.h"
+
+#include <atomic>
+#include <cmath>
+#include "raytracer.h"
+#include "visibilitybuffer.h"
+
+TemporalCache::TemporalCache(int width, int height)
+  : width(width), height(height),
+    previous(width * height), current(width * height), reprojected(width * height) {}
+
+void TemporalCache::invalidate() {
+  for (Sample& sample : previous) {
+    sample.object = nullptr;
+  }
+}
+
+void TemporalCache::render(const Camera& camera, Color* out, ThreadPool& pool, const VisibilityBuffer* primary) {
+  Viewport view(camera, width, height);
+  std::vector<Object*> visible;
+  if (!primary) {
+    visible = frustumCull(view, objects, 0, 0, width, height);
+  }
+
+  // Scatter last frame's hits into the new view, nearest one wins
+  for (Sample& sample : reprojected) {
+    sample.object = nullptr;
+    sample.depth = INFINITY;
+  }
+  for (const Sample& sample : previous) {
+    glm::vec2 pixel;
+    if (!sample.object || sample.age >= maxAge || !view.project(sample.position, pixel)) {
+      continue;
+    }
+    int x = static_cast<int>(std::floor(pixel.x + 0.5f));
+    int y = static_cast<int>(std::floor(pixel.y + 0.5f));
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+      continue;
+    }
+    float depth = glm::length(sample.position - view.origin);
+    Sample& target = reprojected[y * width + x];
+    if (depth < target.depth) {
+      target = sample;
+      target.depth = depth;
+    }
+  }
+
+  std::atomic<long> reusedPixels{0};
+  std::atomic<long> shadedPixels{0};
+
+  pool.parallelFor(height, [&](int y) {
+    long rowReused = 0;
+    long rowShaded = 0;
+    for (int x = 0; x < width; x++) {
+      int i = y * width + x;
+      glm::vec3 rayDirection = view.rayDirection(x, y);
+
+      Hit hit;
+      if (primary) {
+        hit = primary->hit(x, y);
+      } else {
+        rayStats.primary.fetch_add(1, std::memory_order_relaxed);
+        rayStats.primaryTests.fetch_add(visible.size(), std::memory_order_relaxed);
+        hit = traceClosest(visible, view.origin, rayDirection);
+      }
+      Sample& sample = current[i];
+      if (!hit.intersect.isIntersecting) {
+        sample.object = nullptr;
+        out[i] = sampleSkybox(rayDirection);
+        continue;
+      }
+
+      // The old hit still stands for this pixel if it is the same surface
+      // and no further away than the pixel footprints can explain
+      const Sample& candidate = reprojected[i];
+      float footprint = view.cone.spread * hit.intersect.dist;
+      if (candidate.object == hit.object && !candidate.edge &&
+          glm::length(candidate.position - hit.intersect.point) <= 2.0f * footprint) {
+        sample = candidate;
+        sample.age++;
+        rowReused++;
+      } else {
+        sample.position = hit.intersect.point;
+        sample.object = hit.object;
+        sample.shadow = shadowAt(hit);
+        sample.age = 0;
+        rowShaded++;
+      }
+      out[i] = shade(hit, sample.shadow, view.origin, rayDirection, 0, 1.0f, view.cone, pixelPath(x, y));
+    }
+    reusedPixels += rowReused;
+    shadedPixels += rowShaded;
+  });
+
+  // A shadow edge shifts across pixels as the camera moves, so the pixels on
+  // either side of one cast their shadow rays again next frame
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      Sample& sample = current[y * width + x];
+      if (!sample.object) {
+        continue;
+      }
+      auto differs = [&](int nx, int ny) {
+        if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+          return false;
+        }
+        const Sample& other = current[ny * width + nx];
+        return other.object && other.shadow != sample.shadow;
+      };
+      sample.edge = differs(x - 1, y) || differs(x + 1, y) || differs(x, y - 1) || differs(x, y + 1);
+    }
+  }
+
+  reused += reusedPixels;
+  shaded += shadedPixels;
+  std::swap(previous, current);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.h"
+#include "color.h"
+#include "object.h"
+#include "threadpool.h"
+
+class VisibilityBuffer;
+
+// Keeps last frame's primary hits with their shadow factors and reprojects
+// them into the new view. A pixel whose new primary hit lands on the same
+// object, within a couple of pixel footprints of a reprojected hit, reuses
+// that shadow factor instead of casting a shadow ray, unless it lay on a
+// shadow edge. Only the shadow is
+// carried over because it does not depend on the view: the texture is
+// sampled at the new hit, and specular and secondary rays are shaded afresh.
+class TemporalCache {
+public:
+  TemporalCache(int width, int height);
+
+  // Takes primary hits from primary when given, otherwise traces them. Rows
+  // are shaded on pool, so this must not be called from a pool task.
+  void render(const Camera& camera, Color* out, ThreadPool& pool, const VisibilityBuffer* primary = nullptr);
+
+  // Forget everything, e.g. after a light or material change
+  void invalidate();
+
+  long reused = 0;
+  long shaded = 0;
+
+  // Frames a shadow factor may be carried forward before it is cast afresh
+  int maxAge = 16;
+
+private:
+  struct Sample {
+    glm::vec3 position;
+    const Object* object = nullptr;
+    float shadow = 1.0f;
+    bool edge = false;  // next to a pixel in different shadow, never reused
+    float depth = 0.0f;
+    int age = 0;
+  };
+
+  int width;
+  int height;
+  std::vector<Sample> previous;
+  std::vector<Sample> current;
+  std::vector<Sample> reprojected;
+};
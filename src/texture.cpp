@@ -0,0 +1,180 @@
+#include "texture.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <SDL2/SDL_image.h>
+#include <print.h>
+
+namespace {
+
+// Z-order offsets of every texel inside an 8x8 tile
+constexpr std::array<Uint8, 64> buildMortonTable() {
+  std::array<Uint8, 64> table{};
+  for (int y = 0; y < 8; y++) {
+    for (int x = 0; x < 8; x++) {
+      int code = 0;
+      for (int bit = 0; bit < 3; bit++) {
+        code |= ((x >> bit) & 1) << (2 * bit);
+        code |= ((y >> bit) & 1) << (2 * bit + 1);
+      }
+      table[y * 8 + x] = code;
+    }
+  }
+  return table;
+}
+
+constexpr std::array<Uint8, 64> MORTON = buildMortonTable();
+
+Color readSurface(SDL_Surface* surface, int x, int y) {
+  int bpp = surface->format->BytesPerPixel;
+  Uint8 *p = (Uint8 *)surface->pixels + y * surface->pitch + x * bpp;
+  Uint32 pixel;
+  switch (bpp) {
+    case 1:
+      pixel = *p;
+      break;
+    case 2:
+      pixel = *(Uint16 *)p;
+      break;
+    case 3:
+      if (SDL_BYTEORDER == SDL_BIG_ENDIAN) {
+        pixel = p[0] << 16 | p[1] << 8 | p[2];
+      } else {
+        pixel = p[0] | p[1] << 8 | p[2] << 16;
+      }
+      break;
+    case 4:
+      pixel = *(Uint32 *)p;
+      break;
+    default:
+      throw std::runtime_error("Unknown format!");
+  }
+  SDL_Color color;
+  SDL_GetRGB(pixel, surface->format, &color.r, &color.g, &color.b);
+  return Color(color.r, color.g, color.b);
+}
+
+}
+
+Texture::Texture(SDL_Surface* surface, bool mipmapped) {
+  Level base = addLevel(surface->w, surface->h);
+  for (int y = 0; y < base.height; y++) {
+    for (int x = 0; x < base.width; x++) {
+      storage[index(base, x, y)] = readSurface(surface, x, y);
+    }
+  }
+
+  // Box-filter each level down to 1x1; odd sizes clamp the last row/column
+  while (mipmapped && (mips.back().width > 1 || mips.back().height > 1)) {
+    Level parent = mips.back();
+    Level level = addLevel(std::max(1, parent.width / 2), std::max(1, parent.height / 2));
+    for (int y = 0; y < level.height; y++) {
+      for (int x = 0; x < level.width; x++) {
+        int x0 = std::min(2 * x, parent.width - 1);
+        int x1 = std::min(2 * x + 1, parent.width - 1);
+        int y0 = std::min(2 * y, parent.height - 1);
+        int y1 = std::min(2 * y + 1, parent.height - 1);
+        glm::vec3 sum = texel(parent, x0, y0) + texel(parent, x1, y0) + texel(parent, x0, y1) + texel(parent, x1, y1);
+        glm::vec3 average = sum * 0.25f + 0.5f;
+        storage[index(level, x, y)] = Color(int(average.x), int(average.y), int(average.z));
+      }
+    }
+  }
+}
+
+Texture::Texture(const std::vector<Level>& levels, const Color* texels)
+  : mips(levels), texels(texels) {}
+
+Texture::Level Texture::addLevel(int width, int height) {
+  Level level;
+  level.width = width;
+  level.height = height;
+  level.tilesPerRow = (width + TILE - 1) / TILE;
+  level.offset = storage.size();
+
+  storage.resize(storage.size() + tileCount(level) * TILE * TILE);
+  texels = storage.data();
+  mips.push_back(level);
+  return level;
+}
+
+bool Texture::fits(const std::vector<Level>& levels, size_t texelCount) {
+  // Far above any real texture, and small enough that sizes cannot overflow
+  const int MAX_SIDE = 1 << 16;
+  if (levels.empty()) {
+    return false;
+  }
+  for (const Level& level : levels) {
+    if (level.width < 1 || level.height < 1 || level.width > MAX_SIDE || level.height > MAX_SIDE ||
+        level.tilesPerRow != (level.width + TILE - 1) / TILE ||
+        level.offset > texelCount || tileCount(level) * TILE * TILE > texelCount - level.offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t Texture::index(const Level& level, int x, int y) const {
+  size_t tile = static_cast<size_t>(y / TILE) * level.tilesPerRow + x / TILE;
+  return level.offset + tile * TILE * TILE + MORTON[(y % TILE) * TILE + x % TILE];
+}
+
+glm::vec3 Texture::texel(const Level& level, int x, int y) const {
+  const Color& c = texels[index(level, x, y)];
+  return glm::vec3(c.r, c.g, c.b);
+}
+
+glm::vec3 Texture::bilinear(const Level& level, const glm::vec2& uv) const {
+  // Texel centres sit at half-integer coordinates; addresses clamp to the edge
+  float fx = uv.x * level.width - 0.5f;
+  float fy = uv.y * level.height - 0.5f;
+  int x0 = static_cast<int>(std::floor(fx));
+  int y0 = static_cast<int>(std::floor(fy));
+  float tx = fx - x0;
+  float ty = fy - y0;
+
+  int x1 = std::clamp(x0 + 1, 0, level.width - 1);
+  int y1 = std::clamp(y0 + 1, 0, level.height - 1);
+  x0 = std::clamp(x0, 0, level.width - 1);
+  y0 = std::clamp(y0, 0, level.height - 1);
+
+  glm::vec3 top = glm::mix(texel(level, x0, y0), texel(level, x1, y0), tx);
+  glm::vec3 bottom = glm::mix(texel(level, x0, y1), texel(level, x1, y1), tx);
+  return glm::mix(top, bottom, ty);
+}
+
+Color Texture::sample(const glm::vec2& uv, float footprint, TextureFilter filter) const {
+  if (filter == TextureFilter::Nearest) {
+    const Level& level = mips[0];
+    int x = std::clamp(static_cast<int>(uv.x * (level.width - 1)), 0, level.width - 1);
+    int y = std::clamp(static_cast<int>(uv.y * (level.height - 1)), 0, level.height - 1);
+    return texels[index(level, x, y)];
+  }
+
+  // A footprint covering n texels of the base level maps to mip log2(n)
+  float lod = 0.0f;
+  if (filter == TextureFilter::Trilinear && footprint > 0) {
+    lod = std::clamp(std::log2(footprint * std::max(width(), height())), 0.0f, float(levels() - 1));
+  }
+
+  int fine = static_cast<int>(lod);
+  glm::vec3 color = bilinear(mips[fine], uv);
+  float blend = lod - fine;
+  if (blend > 0 && fine + 1 < levels()) {
+    color = glm::mix(color, bilinear(mips[fine + 1], uv), blend);
+  }
+  return Color(int(color.x + 0.5f), int(color.y + 0.5f), int(color.z + 0.5f));
+}
+
+Texture* loadTexture(const std::string& path, bool mipmapped) {
+  SDL_Surface* surface = IMG_Load(path.c_str());
+  if (!surface) {
+    print("Error loading texture");
+    return nullptr;
+  }
+  Texture* texture = new Texture(surface, mipmapped);
+  SDL_FreeSurface(surface);
+  return texture;
+}
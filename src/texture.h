@@ -0,0 +1,66 @@
+#pragma once
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "color.h"
+
+enum class TextureFilter { Nearest, Bilinear, Trilinear };
+
+// Material texture decoded once into a mip chain. Every level is stored in
+// 8x8 texel tiles, texels inside a tile in Z (Morton) order, so the handful of
+// texels a lookup touches share a cache line regardless of the ray direction.
+class Texture {
+public:
+  struct Level {
+    int width;
+    int height;
+    int tilesPerRow;
+    size_t offset;
+  };
+
+  // Without mipmapped only the base level is kept
+  Texture(SDL_Surface* surface, bool mipmapped = true);
+  // Wraps texels that already sit in this layout, e.g. inside a mapped asset
+  // bundle. The memory has to outlive the texture.
+  Texture(const std::vector<Level>& levels, const Color* texels);
+
+  // True when levels describe a mip chain whose every texel lies within the
+  // first texelCount, so lookups cannot leave the memory backing it
+  static bool fits(const std::vector<Level>& levels, size_t texelCount);
+
+  int width() const { return mips[0].width; }
+  int height() const { return mips[0].height; }
+  int levels() const { return mips.size(); }
+
+  const std::vector<Level>& levelInfo() const { return mips; }
+  const Color* data() const { return texels; }
+  size_t texelCount() const { return mips.back().offset + tileCount(mips.back()) * TILE * TILE; }
+
+  // Unfiltered texel of the base level
+  Color at(int x, int y) const { return texels[index(mips[0], x, y)]; }
+
+  // footprint is the world-space width a pixel covers at the hit point; the
+  // texture is assumed to span one world unit, as on a unit cube face.
+  Color sample(const glm::vec2& uv, float footprint, TextureFilter filter) const;
+
+private:
+  static const int TILE = 8;
+
+  static size_t tileCount(const Level& level) {
+    return static_cast<size_t>(level.tilesPerRow) * ((level.height + TILE - 1) / TILE);
+  }
+
+  size_t index(const Level& level, int x, int y) const;
+  glm::vec3 texel(const Level& level, int x, int y) const;
+  glm::vec3 bilinear(const Level& level, const glm::vec2& uv) const;
+  Level addLevel(int width, int height);
+
+  std::vector<Level> mips;
+  std::vector<Color> storage; // empty when the texels live in a mapped bundle
+  const Color* texels = nullptr;
+};
+
+// Decodes an image file; prints an error and returns nullptr if it cannot be read
+Texture* loadTexture(const std::string& path, bool mipmapped = true);
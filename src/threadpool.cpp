@@ -0,0 +1,64 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  available.notify_one();
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& body) {
+  std::mutex doneMutex;
+  std::condition_variable done;
+  int remaining = count;
+
+  for (int i = 0; i < count; i++) {
+    submit([&, i] {
+      body(i);
+      std::lock_guard<std::mutex> lock(doneMutex);
+      if (--remaining == 0) {
+        done.notify_all();
+      }
+    });
+  }
+
+  std::unique_lock<std::mutex> lock(doneMutex);
+  done.wait(lock, [&] { return remaining == 0; });
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      available.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
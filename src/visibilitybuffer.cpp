@@ -0,0 +1,272 @@
+#include "visibilitybuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+// Boxes reaching closer than this to the camera plane are not projected
+// but tested against every pixel
+const float NEAR_DEPTH = 1e-3f;
+// Pixels this close outside a projected side still test its object, so
+// rounding in the projection never loses a hit along a silhouette
+const float EDGE_SLACK = 1.0f;
+// Same far limit traceClosest starts its search with
+const float FAR_DEPTH = 99999.0f;
+
+}
+
+VisibilityBuffer::VisibilityBuffer(int width, int height)
+  : width(width), height(height),
+    view(Camera(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f), width, height),
+    samples(width * height) {}
+
+void VisibilityBuffer::rasterize(const Viewport& viewport, const std::vector<Object*>& objects, ThreadPool& pool) {
+  view = viewport;
+  scene = objects;
+
+  std::vector<Primitive> primitives;
+  for (int object = 0; object < static_cast<int>(scene.size()); object++) {
+    glm::vec3 min, max;
+    scene[object]->bounds(min, max);
+
+    float nearest = INFINITY;
+    float farthest = -INFINITY;
+    for (int corner = 0; corner < 8; corner++) {
+      glm::vec3 point(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z);
+      float depth = glm::dot(point - view.origin, view.forward);
+      nearest = std::min(nearest, depth);
+      farthest = std::max(farthest, depth);
+    }
+    // Every primary ray points forward, nothing behind the camera is seen
+    if (farthest <= 0.0f) {
+      continue;
+    }
+    if (nearest < NEAR_DEPTH) {
+      Primitive primitive{object, std::max(nearest, 0.0f), true};
+      primitives.push_back(primitive);
+      continue;
+    }
+
+    // A ray can only enter the box through a side that faces the camera
+    for (int axis = 0; axis < 3; axis++) {
+      for (int side = 0; side < 2; side++) {
+        float plane = side ? max[axis] : min[axis];
+        if (side ? view.origin[axis] <= plane : view.origin[axis] >= plane) {
+          continue;
+        }
+
+        int b = (axis + 1) % 3;
+        int c = (axis + 2) % 3;
+        glm::vec2 screen[4];
+        for (int k = 0; k < 4; k++) {
+          glm::vec3 point;
+          point[axis] = plane;
+          point[b] = (k == 1 || k == 2) ? max[b] : min[b];
+          point[c] = k >= 2 ? max[c] : min[c];
+
+          glm::vec3 d = point - view.origin;
+          float depth = glm::dot(d, view.forward);
+          float screenX = glm::dot(d, view.right) / depth / (view.aspectRatio * view.tanHalfFov);
+          float screenY = glm::dot(d, view.up) / depth / view.tanHalfFov;
+          screen[k] = glm::vec2((screenX + 1.0f) * width / 2.0f, (1.0f - screenY) * height / 2.0f);
+        }
+
+        float area = 0.0f;
+        for (int k = 0; k < 4; k++) {
+          const glm::vec2& a = screen[k];
+          const glm::vec2& e = screen[(k + 1) % 4];
+          area += a.x * e.y - e.x * a.y;
+        }
+        // Seen edge-on, the neighbouring sides cover it
+        if (std::abs(area) < 1e-9f) {
+          continue;
+        }
+        float winding = area > 0.0f ? 1.0f : -1.0f;
+
+        Primitive primitive{object, nearest, false, axis, plane};
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+        for (int k = 0; k < 4; k++) {
+          const glm::vec2& a = screen[k];
+          const glm::vec2& e = screen[(k + 1) % 4];
+          glm::vec2 normal = glm::vec2(a.y - e.y, e.x - a.x) * winding;
+          float length = std::sqrt(normal.x * normal.x + normal.y * normal.y);
+          if (length > 0.0f) {
+            normal = normal * (1.0f / length);
+          }
+          primitive.edges[k] = glm::vec3(normal.x, normal.y, -(normal.x * a.x + normal.y * a.y));
+          minX = std::min(minX, a.x);
+          minY = std::min(minY, a.y);
+          maxX = std::max(maxX, a.x);
+          maxY = std::max(maxY, a.y);
+        }
+
+        // Pixel centres sit at x + 0.5, y + 0.5
+        primitive.minX = std::max(0, static_cast<int>(std::floor(minX - EDGE_SLACK - 0.5f)));
+        primitive.minY = std::max(0, static_cast<int>(std::floor(minY - EDGE_SLACK - 0.5f)));
+        primitive.maxX = std::min(width - 1, static_cast<int>(std::ceil(maxX + EDGE_SLACK - 0.5f)));
+        primitive.maxY = std::min(height - 1, static_cast<int>(std::ceil(maxY + EDGE_SLACK - 0.5f)));
+        if (primitive.minX <= primitive.maxX && primitive.minY <= primitive.maxY) {
+          primitives.push_back(primitive);
+        }
+      }
+    }
+  }
+
+  // Nearest boxes first lets a pixel skip most of what lies behind its hit;
+  // the sides of one box stay together so it is tested once per pixel
+  std::stable_sort(primitives.begin(), primitives.end(), [](const Primitive& a, const Primitive& b) {
+    return a.nearest < b.nearest || (a.nearest == b.nearest && a.object < b.object);
+  });
+
+  tilesX = (width + tileSize - 1) / tileSize;
+  tilesY = (height + tileSize - 1) / tileSize;
+  bins.assign(tilesX * tilesY, {});
+  for (int i = 0; i < static_cast<int>(primitives.size()); i++) {
+    const Primitive& primitive = primitives[i];
+    int tx0 = primitive.fullScreen ? 0 : primitive.minX / tileSize;
+    int ty0 = primitive.fullScreen ? 0 : primitive.minY / tileSize;
+    int tx1 = primitive.fullScreen ? tilesX - 1 : primitive.maxX / tileSize;
+    int ty1 = primitive.fullScreen ? tilesY - 1 : primitive.maxY / tileSize;
+    for (int ty = ty0; ty <= ty1; ty++) {
+      for (int tx = tx0; tx <= tx1; tx++) {
+        bins[ty * tilesX + tx].push_back(i);
+      }
+    }
+  }
+
+  pool.parallelFor(tilesX * tilesY, [&](int tile) { resolveTile(tile, primitives); });
+}
+
+void VisibilityBuffer::resolveTile(int tile, const std::vector<Primitive>& primitives) {
+  int x0 = (tile % tilesX) * tileSize;
+  int y0 = (tile / tilesX) * tileSize;
+  int w = std::min(tileSize, width - x0);
+  int h = std::min(tileSize, height - y0);
+
+  std::vector<glm::vec3> directions(w * h);
+  std::vector<Intersect> closest(w * h);
+  std::vector<float> depth(w * h, FAR_DEPTH);
+  std::vector<int> winner(w * h, -1);
+  std::vector<int> tested(w * h, -1);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      directions[y * w + x] = view.rayDirection(x0 + x, y0 + y);
+    }
+  }
+
+  long tests = 0;
+  for (int index : bins[tile]) {
+    const Primitive& primitive = primitives[index];
+    int fromX = primitive.fullScreen ? x0 : std::max(x0, primitive.minX);
+    int fromY = primitive.fullScreen ? y0 : std::max(y0, primitive.minY);
+    int toX = primitive.fullScreen ? x0 + w - 1 : std::min(x0 + w - 1, primitive.maxX);
+    int toY = primitive.fullScreen ? y0 + h - 1 : std::min(y0 + h - 1, primitive.maxY);
+
+    for (int y = fromY; y <= toY; y++) {
+      for (int x = fromX; x <= toX; x++) {
+        int i = (y - y0) * w + (x - x0);
+        if (tested[i] == primitive.object) {
+          continue;
+        }
+
+        if (!primitive.fullScreen) {
+          bool covered = true;
+          for (const glm::vec3& edge : primitive.edges) {
+            if (edge.x * (x + 0.5f) + edge.y * (y + 0.5f) + edge.z < -EDGE_SLACK) {
+              covered = false;
+              break;
+            }
+          }
+          if (!covered) {
+            continue;
+          }
+
+          // The object's surface is no nearer than the box side the ray
+          // enters through, so a side behind the current hit can be skipped
+          float entry = (primitive.plane - view.origin[primitive.axis]) / directions[i][primitive.axis];
+          if (entry > depth[i] * (1.0f + 1e-4f) + 1e-4f) {
+            continue;
+          }
+        }
+
+        tested[i] = primitive.object;
+        tests++;
+        Intersect hit = scene[primitive.object]->rayIntersect(view.origin, directions[i]);
+        // traceClosest keeps the first object in scene order on a tie
+        if (hit.isIntersecting && (hit.dist < depth[i] || (hit.dist == depth[i] && primitive.object < winner[i]))) {
+          depth[i] = hit.dist;
+          winner[i] = primitive.object;
+          closest[i] = hit;
+        }
+      }
+    }
+  }
+
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int i = y * w + x;
+      Sample& sample = samples[(y0 + y) * width + x0 + x];
+      sample.object = winner[i];
+      if (winner[i] >= 0) {
+        sample.depth = closest[i].dist;
+        sample.normal = closest[i].normal;
+        sample.uv = closest[i].uv;
+      }
+    }
+  }
+
+  rayStats.primary.fetch_add(w * h, std::memory_order_relaxed);
+  rayStats.primaryTests.fetch_add(tests, std::memory_order_relaxed);
+}
+
+Hit VisibilityBuffer::hit(int x, int y) const {
+  Hit hit;
+  const Sample& sample = samples[y * width + x];
+  if (sample.object < 0) {
+    return hit;
+  }
+  hit.object = scene[sample.object];
+  glm::vec3 point = view.origin + sample.depth * view.rayDirection(x, y);
+  hit.intersect = Intersect{true, sample.depth, point, sample.normal, sample.uv};
+  return hit;
+}
+
+int VisibilityBuffer::verify(ThreadPool& pool) const {
+  std::atomic<int> mismatches{0};
+  pool.parallelFor(height, [&](int y) {
+    int rowMismatches = 0;
+    for (int x = 0; x < width; x++) {
+      Hit traced = traceClosest(scene, view.origin, view.rayDirection(x, y));
+      Hit rasterized = hit(x, y);
+      const Intersect& a = traced.intersect;
+      const Intersect& b = rasterized.intersect;
+      bool same = traced.object == rasterized.object && a.isIntersecting == b.isIntersecting;
+      if (same && a.isIntersecting) {
+        same = a.dist == b.dist && a.point == b.point && a.normal == b.normal && a.uv == b.uv;
+      }
+      if (!same) {
+        rowMismatches++;
+      }
+    }
+    mismatches += rowMismatches;
+  });
+  return mismatches;
+}
+
+void shadeVisible(const VisibilityBuffer& visibility, Color* out, ThreadPool& pool) {
+  const Viewport& view = visibility.viewport();
+
+  pool.parallelFor(visibility.height, [&](int y) {
+    for (int x = 0; x < visibility.width; x++) {
+      glm::vec3 rayDirection = view.rayDirection(x, y);
+      Hit hit = visibility.hit(x, y);
+      if (!hit.intersect.isIntersecting) {
+        out[y * visibility.width + x] = sampleSkybox(rayDirection);
+      } else {
+        out[y * visibility.width + x] = shade(hit, view.origin, rayDirection, 0, 1.0f, view.cone, pixelPath(x, y));
+      }
+    }
+  });
+}
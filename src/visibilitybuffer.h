@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "object.h"
+#include "raytracer.h"
+#include "threadpool.h"
+
+// Primary visibility found by rasterizing the bounding boxes of the scene
+// into screen tiles instead of testing every object for every pixel. A
+// pixel only runs the exact rayIntersect of the boxes whose projection
+// reaches it, nearest box first, and keeps the winner with traceClosest's
+// rules, so the stored hits are the ones the tracer would find.
+class VisibilityBuffer {
+public:
+  VisibilityBuffer(int width, int height);
+
+  // Bins the camera-facing sides of every object's bounds into tiles and
+  // resolves the tiles on the pool. Must not be called from a pool task.
+  void rasterize(const Viewport& view, const std::vector<Object*>& scene, ThreadPool& pool);
+
+  // Primary hit through pixel (x, y) as of the last rasterize()
+  Hit hit(int x, int y) const;
+
+  const Viewport& viewport() const { return view; }
+
+  // Pixels whose hit differs from a full traceClosest over the scene, traced
+  // on pool like rasterize() so the two can be timed against each other
+  int verify(ThreadPool& pool) const;
+
+  int width;
+  int height;
+  int tileSize = 32;
+
+private:
+  // Primitive ID, depth, normal and surface coordinates of the nearest hit;
+  // the hit point is origin + depth * direction, as every object computes it
+  struct Sample {
+    int object = -1;  // index into the scene, -1 when the ray escapes
+    float depth = 0.0f;
+    glm::vec3 normal;
+    glm::vec2 uv;
+  };
+
+  // One camera-facing side of a bounding box in screen space
+  struct Primitive {
+    int object;
+    float nearest;    // closest camera depth of the whole box, for ordering
+    bool fullScreen;  // box touches the camera plane, test every pixel
+    int axis = 0;
+    float plane = 0.0f;  // box side lies at coordinate `plane` along `axis`
+    glm::vec3 edges[4] = {};  // inward edge equations, distances in pixels
+    int minX = 0, minY = 0, maxX = 0, maxY = 0;
+  };
+
+  void resolveTile(int tile, const std::vector<Primitive>& primitives);
+
+  Viewport view;
+  std::vector<Object*> scene;
+  std::vector<Sample> samples;
+  std::vector<std::vector<int>> bins;
+  int tilesX = 0;
+  int tilesY = 0;
+};
+
+// Shades every pixel of a rasterized frame on pool, tracing only shadow and
+// secondary rays from the stored primary hits
+void shadeVisible(const VisibilityBuffer& visibility, Color* out, ThreadPool& pool);
@@ -0,0 +1,121 @@
+#include "voxelquad.h"
+
+#include <cmath>
+
+namespace {
+
+// Tolerance Cube::rayIntersect accepts hit points with
+const float CUBE_EPSILON = 1e-6f;
+// Looser margin for the quick tests, so rounding never rejects a point a cube accepts
+const float MARGIN = 1e-5f;
+
+}
+
+VoxelQuad::VoxelQuad(std::shared_ptr<const VoxelPlane> plane, const glm::vec4& equation,
+                     int b0, int c0, int b1, int c1, const Material& mat)
+  : plane(plane), equation(equation), Object(mat) {
+  int axis = plane->axis;
+  int b = (axis + 1) % 3;
+  int c = (axis + 2) % 3;
+  float half = plane->side / 2.0f;
+  float offset = equation.w * equation[axis];
+
+  low[axis] = high[axis] = offset;
+  low[b] = b0 * plane->side - half;
+  high[b] = b1 * plane->side + half;
+  low[c] = c0 * plane->side - half;
+  high[c] = c1 * plane->side + half;
+}
+
+Intersect VoxelQuad::rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const {
+  glm::vec3 normal(equation);
+  float denom = glm::dot(normal, rayDirection);
+  if (std::abs(denom) <= 1e-6) {
+    return Intersect{false};
+  }
+  float t = (equation.w - glm::dot(normal, rayOrigin)) / denom;
+  if (t < 0) {
+    return Intersect{false};
+  }
+
+  glm::vec3 point = rayOrigin + t * rayDirection;
+  int b = (plane->axis + 1) % 3;
+  int c = (plane->axis + 2) % 3;
+  if (point[b] < low[b] - MARGIN || point[b] > high[b] + MARGIN ||
+      point[c] < low[c] - MARGIN || point[c] > high[c] + MARGIN) {
+    return Intersect{false};
+  }
+
+  // Near a cell edge several cubes accept the point; like a scan over the
+  // original scene, the nearest hit wins and ties go to the earlier cube
+  float half = plane->side / 2.0f;
+  int ib = static_cast<int>(std::floor(point[b] / plane->side + 0.5f));
+  int ic = static_cast<int>(std::floor(point[c] / plane->side + 0.5f));
+  const VoxelPlane::Cell* best = nullptr;
+  Intersect closest{false};
+  for (int db = -1; db <= 1; db++) {
+    for (int dc = -1; dc <= 1; dc++) {
+      auto it = plane->cells.find(VoxelPlane::key(ib + db, ic + dc));
+      if (it == plane->cells.end()) {
+        continue;
+      }
+      const VoxelPlane::Cell& cell = it->second;
+      const glm::vec3& center = cell.cube->getCenter();
+      if (std::abs(point[b] - center[b]) > half + CUBE_EPSILON ||
+          std::abs(point[c] - center[c]) > half + CUBE_EPSILON) {
+        continue;
+      }
+
+      // The cube may resolve the ray on another of its faces; that hit
+      // belongs to the quad of that face, unless the face was dropped and
+      // the ray only grazes it along the edge it shares with this one
+      Intersect i = cell.cube->rayIntersect(rayOrigin, rayDirection);
+      if (!i.isIntersecting) {
+        continue;
+      }
+      if (i.dist != t && !((cell.hiddenFaces & (1 << cell.cube->faceOf(i))) &&
+                           std::abs(i.point[plane->axis] - low[plane->axis]) <= MARGIN)) {
+        continue;
+      }
+      if (!best || i.dist < closest.dist || (i.dist == closest.dist && cell.order < best->order)) {
+        best = &cell;
+        closest = i;
+      }
+    }
+  }
+
+  // A winning cell merged into another quad is reported by that quad
+  if (!best || best->quad != this) {
+    return Intersect{false};
+  }
+  return closest;
+}
+
+void VoxelQuad::bounds(glm::vec3& min, glm::vec3& max) const {
+  // The cubes accept hits slightly outside their faces
+  min = low - glm::vec3(MARGIN);
+  max = high + glm::vec3(MARGIN);
+}
+
+std::vector<Face> VoxelQuad::faces() const {
+  int axis = plane->axis;
+  int b = (axis + 1) % 3;
+  int c = (axis + 2) % 3;
+  glm::vec3 u(0.0f), v(0.0f);
+  u[b] = high[b] - low[b];
+  v[c] = high[c] - low[c];
+  glm::vec3 normal(0.0f);
+  normal[axis] = equation[axis];
+  return {Face{low, u, v, normal}};
+}
+
+int VoxelQuad::faceOf(const Intersect& hit) const {
+  // Hits the owning cube resolved on one of its other sides have no face here
+  int axis = plane->axis;
+  for (int i = 0; i < 3; i++) {
+    if (std::abs(hit.normal[i]) > std::abs(hit.normal[axis])) {
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "cube.h"
+#include "object.h"
+#include "material.h"
+#include "intersect.h"
+
+class VoxelQuad;
+
+// Every exposed face of a voxel grid lying in one plane and facing one way,
+// keyed by the face's cell coordinates within the plane
+struct VoxelPlane {
+  struct Cell {
+    const Cube* cube;
+    int order;              // position of the cube in the original scene
+    const VoxelQuad* quad;  // merged face the cell ended up in
+    int hiddenFaces;        // bit per Cube::faceOf index pressed against a neighbour
+  };
+
+  static long long key(int b, int c) { return (static_cast<long long>(b) << 32) ^ static_cast<unsigned>(c); }
+
+  int axis;
+  float side;
+  std::unordered_map<long long, Cell> cells;
+};
+
+// Rectangle of same-material cube faces merged by compileScene. It finds
+// the hit with one plane test and then asks the original cube under the hit
+// point for the exact Intersect, so distances, normals and per-block UVs
+// are the ones the cube would have produced.
+class VoxelQuad : public Object {
+public:
+  // Covers cells [b0, b1] x [c0, c1] of plane, whose equation is
+  // dot(normal, p) = w as the cubes write it
+  VoxelQuad(std::shared_ptr<const VoxelPlane> plane, const glm::vec4& equation,
+            int b0, int c0, int b1, int c1, const Material& mat);
+
+  Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const override;
+
+  void bounds(glm::vec3& min, glm::vec3& max) const override;
+  std::vector<Face> faces() const override;
+  int faceOf(const Intersect& hit) const override;
+
+private:
+  std::shared_ptr<const VoxelPlane> plane;
+  glm::vec4 equation;
+  glm::vec3 low;
+  glm::vec3 high;
+};